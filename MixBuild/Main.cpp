@@ -1,13 +1,22 @@
 ﻿#include <Windows.h>
 #include <ShlObj.h>
-#include <GL/glut.h>
+#include <GL/freeglut.h>
 #include <rapidjson/document.h>
 #include <rapidjson/writer.h>
 #include <rapidjson/stringbuffer.h>
 #include <rapidjson/prettywriter.h>
 #include <fstream>
+#include <iostream>
+#include <atomic>
+#include <chrono>
+#include <future>
 #include "rc.h"
 #include "viewer.h"
+#include "scheduler.h"
+#include "mesh.h"
+#include "mbm.h"
+#include "slice.h"
+#include "trace.h"
 
 using namespace std;
 
@@ -17,10 +26,88 @@ viewer::Frustum __frustum;
 viewer::WorldTransform __world;
 viewer::TransformController __controller;
 
-rc::PointCloud reconstruct_point_cloud(const String image_path, Size& out_image_size, rc::NormalSet& out_normal_set);
-string generate_output_file(const rc::PointCloud point_cloud, const rc::NormalSet normal_set, const string output_path);
-void generate_result_status(const bool status, const string result_path, const string output_path);
-rc::PointCloud map_point_cloud_coordinate(const rc::PointCloud point_cloud, const Size image_size, const Size window_size);
+// the carved volume is mostly empty or solid bricks, so keep only the surface bricks around
+typedef rc::SparseVolume ModelVolume;
+
+// budget mode of a job (budget.json next to the images), the estimate & the outcome go to status.json
+struct BudgetReport
+{
+	bool enabled = false;
+	rc::CarvingBudget budget;
+	rc::CarvingEstimate estimate;
+	rc::CarvingEstimate actual;
+};
+
+// refinement level of a progressive reconstruction, level_count - 1 is the final model
+struct ProgressiveLevel
+{
+	int level = 0;
+	int level_count = 0;
+};
+
+typedef function<void(const rc::PointCloud&, const rc::NormalSet&, const rc::Lattice&, const ProgressiveLevel&)> PreviewCallback;
+
+// named shared memory holding the .mbm image of the final model, a front end on the same machine
+// opens it by name (OpenFileMapping) & decodes it in place instead of waiting for model.stl
+struct SharedMesh
+{
+	string name;
+	size_t size = 0;
+	HANDLE mapping = NULL;
+	void* view = NULL;
+};
+
+struct BatchJob
+{
+	String image_path;
+	int cube_size = 10;
+	BudgetReport report;
+	rc::IslandFilter island_filter;
+	double run_seconds = 0; // carve to decimate, without the waits in the pool queue
+	rc::ImageSrcSet image_src_set;
+	rc::ImageSet image_set;
+	rc::OthProjection oth_proj;
+	Size image_size;
+	ModelVolume volume;
+	rc::Lattice lattice;
+	rc::PointCloud vertices_point_cloud;
+	rc::NormalSet normal_set;
+	rc::WorldPointCloud mapped_point_cloud;
+	mesh::LodSet lod_set;
+};
+
+typedef function<void(BatchJob&)> BatchStage;
+
+bool parse_batch_arguments(int argc, char* argv[], vector<String>& out_image_paths, size_t& out_max_in_flight);
+void run_batch(const vector<String>& image_paths, const size_t max_in_flight);
+void __schedule_batch_stage(scheduler::WorkStealingPool& pool, const vector<BatchStage>& stages, size_t stage_idx, shared_ptr<BatchJob> job, function<void()> on_finished);
+void __decode_batch_job(BatchJob& job);
+void __segment_batch_job(BatchJob& job);
+void __carve_batch_job(BatchJob& job);
+void __extract_batch_job(BatchJob& job);
+void __decimate_batch_job(BatchJob& job);
+void __write_batch_job(BatchJob& job);
+bool reconstruct_volume(const String image_path, Size& out_image_size, ModelVolume& out_volume, rc::Lattice& out_lattice, BudgetReport& out_report, const int level_count = 1, PreviewCallback publish_preview = nullptr);
+rc::PointCloud reconstruct_point_cloud(const String image_path, Size& out_image_size, rc::Lattice& out_lattice, rc::NormalSet& out_normal_set, BudgetReport& out_report, const int level_count = 1, PreviewCallback publish_preview = nullptr);
+void publish_preview_output(const vector<uint8_t>& compact_mesh, const int cube_size, const string output_path, const ProgressiveLevel& progress);
+bool read_budget_file(const string image_path, rc::CarvingBudget& out_budget);
+bool read_printer_file(const string image_path, slice::PrinterProfile& out_profile);
+bool read_island_file(const string image_path, rc::IslandFilter& out_filter);
+int select_budget_cube_size(const rc::ImageSrcSet& image_src_set, BudgetReport& report);
+double measure_model_memory(const rc::PointCloud& point_cloud, const rc::NormalSet& normal_set, const rc::WorldPointCloud& mapped_point_cloud, const mesh::LodSet& lod_set);
+double __seconds_since(const chrono::steady_clock::time_point start);
+string generate_output_file(const rc::WorldPointCloud& point_cloud, const rc::NormalSet normal_set, const string output_path);
+string generate_lod_output_file(const mesh::Mesh& mesh, const int level, const string output_path);
+string generate_compact_output_file(const rc::PointCloud& point_cloud, const rc::NormalSet& normal_set, const rc::Lattice& lattice, const Size image_size, const Size window_size, const string output_path);
+vector<uint8_t> encode_compact_mesh(const rc::PointCloud& point_cloud, const rc::NormalSet& normal_set, const rc::Lattice& lattice, const Size image_size, const Size window_size);
+string generate_slice_output_file(const ModelVolume& volume, const slice::PrinterProfile& profile, const string output_path);
+bool create_shared_mesh(const vector<uint8_t>& data, const string name, SharedMesh& out_shared_mesh);
+void release_shared_mesh(SharedMesh& shared_mesh);
+void generate_result_status(const bool status, const string result_path, const string output_path, const BudgetReport& report = BudgetReport(), const ProgressiveLevel& progress = ProgressiveLevel(), const SharedMesh& shared_mesh = SharedMesh(), const bool files_written = true);
+rapidjson::Value __carving_estimate_value(const rc::CarvingEstimate& estimate, rapidjson::Document::AllocatorType& allocator);
+rc::WorldPointCloud map_point_cloud_coordinate(const rc::PointCloud& point_cloud, const rc::Lattice& lattice, const Size image_size, const Size window_size);
+bool load_view_mesh(const string path, mbm::GpuMesh& out_mesh);
+void draw_view_mesh(const mbm::GpuMesh& mesh);
 void render_model(int argc, char** argv, Size Window_size, function<void()> draw_callback);
 void __init_perspective_view(int width, int height);
 void __init_lighting();
@@ -28,9 +115,59 @@ void __display();
 void __reshape(int w, int h);
 void __mouse(int button, int state, int x, int y);
 void __motion(int x, int y);
+bool __has_argument(int argc, char* argv[], const string name);
 
 int main(int argc, char* argv[])
 {
+	RC_TRACE_THREAD_NAME("main");
+
+	// batch mode, e.g. MixBuild.exe --batch [--in-flight 8] <job dir | @job list file>...
+	if (argc > 1 && string(argv[1]) == "--batch")
+	{
+		vector<String> image_paths;
+		size_t max_in_flight;
+		if (!parse_batch_arguments(argc, argv, image_paths, max_in_flight))
+		{
+			cerr << "usage: MixBuild.exe --batch [--in-flight <job count>] <job dir | @job list file>..." << endl;
+			return 1;
+		}
+		run_batch(image_paths, max_in_flight);
+		RC_TRACE_WRITE("trace.json");
+		return 0;
+	}
+
+	// view mode, e.g. MixBuild.exe --view <model.mbm | binary stl>, shows an existing result without reconstructing,
+	// the ascii model.stl is not read, open the model.mbm written next to it
+	if (argc > 1 && string(argv[1]) == "--view")
+	{
+		if (argc < 3)
+		{
+			cerr << "usage: MixBuild.exe --view <model.mbm | binary stl>" << endl;
+			return 1;
+		}
+
+		mbm::GpuMesh view_mesh;
+		if (!load_view_mesh(argv[2], view_mesh))
+		{
+			cerr << "cannot load " << argv[2] << endl;
+			return 1;
+		}
+
+		FreeConsole();
+		render_model(argc, argv, __window_size, [&]() { draw_view_mesh(view_mesh); });
+		return 0;
+	}
+
+	// progressive mode, e.g. MixBuild.exe --progressive, publishes a coarse model right away & refines it
+	const int level_count = __has_argument(argc, argv, "--progressive") ? 3 : 1;
+
+	// slice mode, e.g. MixBuild.exe --slice, writes the printer layers (printer.json) of the volume instead of a mesh
+	const bool slice_only = __has_argument(argc, argv, "--slice");
+
+	// shared mode, e.g. MixBuild.exe --shared, hands the final model over in shared memory
+	// & writes the files in the background
+	const bool shared = __has_argument(argc, argv, "--shared");
+
 	// hide the console
 	FreeConsole();
 
@@ -40,30 +177,130 @@ int main(int argc, char* argv[])
 	image_path = String(String(folder) + "\\MixBuild");
 
 	Size image_size;
+	rc::Lattice lattice;
 	rc::NormalSet normal_set;
-	auto vertices_point_cloud = reconstruct_point_cloud(image_path, image_size, normal_set);
-	auto mapped_point_cloud = map_point_cloud_coordinate(vertices_point_cloud, image_size, __window_size);
+	BudgetReport report;
+
+	if (slice_only)
+	{
+		ModelVolume volume;
+		string slice_file_path;
+		if (reconstruct_volume(image_path, image_size, volume, lattice, report))
+		{
+			slice::PrinterProfile profile;
+			if (read_printer_file(image_path, profile)) slice_file_path = generate_slice_output_file(volume, profile, image_path);
+		}
+
+		generate_result_status(!slice_file_path.empty(), slice_file_path, image_path, report);
+		RC_TRACE_WRITE(image_path + "\\trace.json");
+		return 0;
+	}
 
-	string output_file_path = generate_output_file(mapped_point_cloud, normal_set, image_path);
-	generate_result_status(true, output_file_path, image_path);
+	// the carving thread only encodes a preview, the file is written while the next level is carved
+	future<void> preview_writer;
+	auto publish_preview = [&](const rc::PointCloud& point_cloud, const rc::NormalSet& preview_normal_set, const rc::Lattice& preview_lattice, const ProgressiveLevel& progress)
+	{
+		auto compact_mesh = encode_compact_mesh(point_cloud, preview_normal_set, preview_lattice, image_size, __window_size);
+		if (preview_writer.valid()) preview_writer.wait();
+
+		preview_writer = async(launch::async, [&image_path, compact_mesh = move(compact_mesh), cube_size = preview_lattice.cube_size, progress]()
+		{
+			RC_TRACE_THREAD_NAME("preview_writer");
+			publish_preview_output(compact_mesh, cube_size, image_path, progress);
+		});
+	};
+	auto vertices_point_cloud = reconstruct_point_cloud(image_path, image_size, lattice, normal_set, report, level_count, publish_preview);
+
+	// the final files must not be overwritten by a late preview
+	if (preview_writer.valid()) preview_writer.wait();
+	auto mesh_start = chrono::steady_clock::now();
+
+	// decimated levels of detail for the viewer & lightweight consumers
+	rc::WorldPointCloud mapped_point_cloud;
+	mesh::LodSet lod_set;
+	atomic<bool> lod_set_ready{ false };
+	auto create_lod_set = [&]()
+	{
+		mapped_point_cloud = map_point_cloud_coordinate(vertices_point_cloud, lattice, image_size, __window_size);
+		mesh::Mesh full_mesh;
+		mesh::create_mesh(vertices_point_cloud, mapped_point_cloud, full_mesh);
+		mesh::generate_lod_set(full_mesh, lod_set);
+		lod_set_ready.store(true, memory_order_release);
+
+		report.actual.seconds += __seconds_since(mesh_start);
+		report.actual.memory_size += measure_model_memory(vertices_point_cloud, normal_set, mapped_point_cloud, lod_set);
+	};
+
+	ProgressiveLevel progress{ level_count - 1, level_count };
+	auto write_output_files = [&]()
+	{
+		string output_file_path = generate_output_file(mapped_point_cloud, normal_set, image_path);
+		for (auto level = 1; level < lod_set.size(); level++)
+		{
+			generate_lod_output_file(lod_set[level], level, image_path);
+		}
+		generate_compact_output_file(vertices_point_cloud, normal_set, lattice, image_size, __window_size, image_path);
+		return output_file_path;
+	};
+
+	// the model is handed over as soon as the surface & normals exist, the mesh, the levels of detail & the files
+	// are made in the background. the mapping lives as long as the viewer, the background work is awaited once the viewer is closed
+	SharedMesh shared_mesh;
+	mbm::GpuMesh shared_view_mesh;
+	future<void> file_writer;
+	if (shared && create_shared_mesh(
+		encode_compact_mesh(vertices_point_cloud, normal_set, lattice, image_size, __window_size),
+		"Local\\MixBuild_model_" + to_string(GetCurrentProcessId()),
+		shared_mesh))
+	{
+		// the viewer shows the shared model until the levels of detail are ready
+		mbm::decode_mesh((const uint8_t*)shared_mesh.view, shared_mesh.size, shared_view_mesh);
+
+		// no path until the files are written, front ends that only read the files wait for the next status
+		generate_result_status(false, "", image_path, report, progress, shared_mesh, false);
+
+		file_writer = async(launch::async, [&]()
+		{
+			RC_TRACE_THREAD_NAME("file_writer");
+			create_lod_set();
+			string output_file_path = write_output_files();
+			generate_result_status(true, output_file_path, image_path, report, progress, shared_mesh, true);
+			RC_TRACE_WRITE(image_path + "\\trace.json");
+		});
+	}
+	else
+	{
+		create_lod_set();
+		string output_file_path = write_output_files();
+		generate_result_status(true, output_file_path, image_path, report, progress);
+		RC_TRACE_WRITE(image_path + "\\trace.json");
+	}
 
 	auto draw_callback = [&]()
 	{
+		if (!lod_set_ready.load(memory_order_acquire))
+		{
+			draw_view_mesh(shared_view_mesh);
+			return;
+		}
+
+		auto& lod = lod_set[viewer::select_lod_level(__frustum, __world, lod_set.size())];
+
 		glFrontFace(GL_CCW);
-		for (auto normal_idx = 0; normal_idx < normal_set.size(); normal_idx++)
+		glColor4d(.4, .6, .93, 1);
+		glBegin(GL_TRIANGLES);
+		for (auto triangle_idx = 0; triangle_idx < lod.triangles.size(); triangle_idx++)
 		{
-			glColor4d(.4, .6, .93, 1);
-			glBegin(GL_POLYGON);
-			glNormal3f(normal_set[normal_idx].x, normal_set[normal_idx].y, normal_set[normal_idx].z);
+			auto& normal = lod.normals[triangle_idx];
+			glNormal3f(normal.x, normal.y, normal.z);
 
-			for (auto vertices_idx = normal_idx * 4; vertices_idx < normal_idx * 4 + 4; vertices_idx++)
+			for (auto i = 0; i < 3; i++)
 			{
-				auto point = mapped_point_cloud[vertices_idx];
+				auto& point = lod.vertices[lod.triangles[triangle_idx][i]];
 				glVertex3f(point.x, point.y, point.z);
 			}
-
-			glEnd();
 		}
+		glEnd();
 		glFrontFace(GL_CW);
 	};
 
@@ -71,35 +308,406 @@ int main(int argc, char* argv[])
 
 	waitKey();
 
+	if (file_writer.valid()) file_writer.wait();
+	release_shared_mesh(shared_mesh);
+
 	return 0;
 }
 
-// reconstuct point cloud
-rc::PointCloud reconstruct_point_cloud(const String image_path, Size& out_image_size, rc::NormalSet& out_normal_set)
+// parse the job directories of batch mode, a "@file" argument lists one directory per line
+// false on a malformed argument
+bool parse_batch_arguments(int argc, char* argv[], vector<String>& out_image_paths, size_t& out_max_in_flight)
 {
+	out_image_paths.clear();
+	out_max_in_flight = max(thread::hardware_concurrency(), 1u);
+
+	for (auto i = 2; i < argc; i++)
+	{
+		string arg = argv[i];
+
+		if (arg.empty()) return false;
+
+		if (arg == "--in-flight")
+		{
+			if (i + 1 >= argc) return false;
+
+			char* end;
+			auto value = strtol(argv[++i], &end, 10);
+			if (end == argv[i] || *end != '\0' || value < 1) return false;
+			out_max_in_flight = (size_t)value;
+		}
+		else if (arg.front() == '@')
+		{
+			ifstream ifs(arg.substr(1));
+			if (!ifs) return false;
+
+			string line;
+			while (getline(ifs, line))
+			{
+				if (!line.empty()) out_image_paths.push_back(line);
+			}
+		}
+		else
+		{
+			out_image_paths.push_back(arg);
+		}
+	}
+
+	return true;
+}
+
+// reconstruct every job on a shared work-stealing pool, stages of different jobs overlap
+// and at most max_in_flight jobs hold their images and volumes in memory at a time
+void run_batch(const vector<String>& image_paths, const size_t max_in_flight)
+{
+	const vector<BatchStage> stages = {
+		__decode_batch_job,
+		__segment_batch_job,
+		__carve_batch_job,
+		__extract_batch_job,
+		__decimate_batch_job,
+		__write_batch_job
+	};
+
+	scheduler::WorkStealingPool pool;
+	atomic<size_t> next_job_idx(0);
+	function<void()> admit_job;
+
+	admit_job = [&]()
+	{
+		auto job_idx = next_job_idx++;
+		if (job_idx >= image_paths.size()) return;
+
+		auto job = make_shared<BatchJob>();
+		job->image_path = image_paths[job_idx];
+		__schedule_batch_stage(pool, stages, 0, job, admit_job);
+	};
+
+	for (size_t i = 0; i < max_in_flight; i++)
+	{
+		admit_job();
+	}
+
+	pool.wait_idle();
+}
+
+// queue a stage of the job, the stage queues the next one when it is done
+void __schedule_batch_stage(scheduler::WorkStealingPool& pool, const vector<BatchStage>& stages, size_t stage_idx, shared_ptr<BatchJob> job, function<void()> on_finished)
+{
+	pool.submit([&pool, &stages, stage_idx, job, on_finished]()
+	{
+		bool failed = false;
+		try { stages[stage_idx](*job); }
+		catch (const exception&) { failed = true; }
+
+		if (failed)
+		{
+			generate_result_status(false, "", job->image_path);
+		}
+
+		if (failed || stage_idx + 1 == stages.size())
+		{
+			// free the slot for the next job
+			on_finished();
+			return;
+		}
+
+		__schedule_batch_stage(pool, stages, stage_idx + 1, job, on_finished);
+	});
+}
+
+// batch stage: read & decode the images
+void __decode_batch_job(BatchJob& job)
+{
+	RC_TRACE_SCOPE("batch_decode");
+
+	rc::extract_image_src_set(job.image_path, job.image_src_set);
+	if (read_budget_file(job.image_path, job.report.budget))
+	{
+		job.cube_size = select_budget_cube_size(job.image_src_set, job.report);
+	}
+	read_island_file(job.image_path, job.island_filter);
+	rc::decode_image_set(job.image_src_set, job.image_set, rc::select_decode_scale(job.cube_size));
+}
+
+// batch stage: segment the shapes & build the projections
+void __segment_batch_job(BatchJob& job)
+{
+	RC_TRACE_SCOPE("batch_segment");
+
+	rc::ShapeSet shape_set;
+	rc::extract_shape(job.image_set, shape_set);
+	rc::create_othogonal_projection(shape_set, job.oth_proj, rc::select_decode_scale(job.cube_size), rc::read_image_size(job.image_src_set));
+	job.image_size = rc::get_projection_size(job.oth_proj);
+	job.image_set.clear();
+}
+
+// batch stage: carve the volume
+void __carve_batch_job(BatchJob& job)
+{
+	RC_TRACE_SCOPE("batch_carve");
+
+	auto start = chrono::steady_clock::now();
+	rc::carve_volume(job.oth_proj, job.volume, job.lattice, job.cube_size);
+	job.oth_proj = rc::OthProjection();
+
+	// the pool already runs a job per worker
+	rc::remove_islands(job.volume, job.island_filter, 1);
+	job.run_seconds += __seconds_since(start);
+}
+
+// batch stage: extract the surface
+void __extract_batch_job(BatchJob& job)
+{
+	RC_TRACE_SCOPE("batch_extract");
+
+	auto start = chrono::steady_clock::now();
+	rc::find_surface_vertices(job.volume, job.vertices_point_cloud, job.normal_set);
+
+	job.report.actual.cube_size = job.cube_size;
+	job.report.actual.cell_count = (double)job.volume.count();
+	job.report.actual.face_count = (double)job.normal_set.size();
+	job.report.actual.memory_size = (double)job.volume.memory_size();
+	job.volume = ModelVolume();
+	job.run_seconds += __seconds_since(start);
+}
+
+// batch stage: build the levels of detail
+void __decimate_batch_job(BatchJob& job)
+{
+	RC_TRACE_SCOPE("batch_decimate");
+
+	auto start = chrono::steady_clock::now();
+	job.mapped_point_cloud = map_point_cloud_coordinate(job.vertices_point_cloud, job.lattice, job.image_size, __window_size);
+
+	mesh::Mesh full_mesh;
+	mesh::create_mesh(job.vertices_point_cloud, job.mapped_point_cloud, full_mesh);
+
+	// the pool already runs a job per worker
+	mesh::generate_lod_set(full_mesh, job.lod_set, 4, .25, 1);
+
+	job.run_seconds += __seconds_since(start);
+	job.report.actual.seconds = job.run_seconds;
+	job.report.actual.memory_size += measure_model_memory(job.vertices_point_cloud, job.normal_set, job.mapped_point_cloud, job.lod_set);
+}
+
+// batch stage: write the model, its levels of detail & the status
+void __write_batch_job(BatchJob& job)
+{
+	RC_TRACE_SCOPE("batch_write");
+
+	string output_file_path = generate_output_file(job.mapped_point_cloud, job.normal_set, job.image_path);
+	for (auto level = 1; level < job.lod_set.size(); level++)
+	{
+		generate_lod_output_file(job.lod_set[level], level, job.image_path);
+	}
+	generate_compact_output_file(job.vertices_point_cloud, job.normal_set, job.lattice, job.image_size, __window_size, job.image_path);
+	generate_result_status(true, output_file_path, job.image_path, job.report);
+}
+
+// reconstuct the carved volume, false without images
+// with more than one level, the model is first carved at a coarse cube size & refined to the final one,
+// every level but the last is handed to publish_preview
+bool reconstruct_volume(const String image_path, Size& out_image_size, ModelVolume& out_volume, rc::Lattice& out_lattice, BudgetReport& out_report, const int level_count, PreviewCallback publish_preview)
+{
+	RC_TRACE_SCOPE("reconstruct_volume");
+
+	int cube_size = 10;
+
 	rc::ImageSrcSet image_src_set;
 	try { rc::extract_image_src_set(image_path, image_src_set); }
-	catch (const exception&) { return rc::PointCloud(); }
+	catch (const exception&) { return false; }
+
+	if (read_budget_file(image_path, out_report.budget))
+	{
+		cube_size = select_budget_cube_size(image_src_set, out_report);
+	}
+
+	rc::IslandFilter island_filter;
+	read_island_file(image_path, island_filter);
+	int decode_scale = rc::select_decode_scale(cube_size);
+
+	// decode & segment at the resolution the carving actually samples
+	rc::ImageSet image_set;
+	rc::decode_image_set(image_src_set, image_set, decode_scale);
 
 	rc::ShapeSet shape_set;
-	rc::extract_shape(image_src_set, shape_set);
+	rc::extract_shape(image_set, shape_set);
 
 	rc::OthProjection oth_proj;
-	rc::create_othogonal_projection(shape_set, oth_proj);
-	out_image_size = oth_proj.front.size();
+	rc::create_othogonal_projection(shape_set, oth_proj, decode_scale, rc::read_image_size(image_src_set));
+	out_image_size = rc::get_projection_size(oth_proj);
 
-	rc::PointCloud point_cloud, vertices_point_cloud;
-	int cube_size = 10;
-	rc::calculate_point_cloud(oth_proj, point_cloud, cube_size);
+	auto carve_start = chrono::steady_clock::now();
+	if (level_count > 1) rc::create_projection_sum_tables(oth_proj);
+
+	auto& volume = out_volume;
+	rc::carve_volume(oth_proj, volume, out_lattice, cube_size << (level_count - 1));
+	rc::remove_islands(volume, island_filter);
+
+	for (auto level = 0; level + 1 < level_count; level++)
+	{
+		// the preview stays a plain mesh, the levels of detail are only built for the final model
+		if (publish_preview)
+		{
+			rc::PointCloud preview_point_cloud;
+			rc::NormalSet preview_normal_set;
+			rc::find_surface_vertices(volume, preview_point_cloud, preview_normal_set);
+			publish_preview(preview_point_cloud, preview_normal_set, out_lattice, ProgressiveLevel{ level, level_count });
+		}
+
+		ModelVolume fine_volume;
+		rc::Lattice fine_lattice;
+		rc::refine_volume(oth_proj, volume, out_lattice, fine_volume, fine_lattice);
+		rc::remove_islands(fine_volume, island_filter);
+		volume = move(fine_volume);
+		out_lattice = fine_lattice;
+	}
 
-	rc::find_surface_vertices(point_cloud, vertices_point_cloud, out_normal_set, cube_size, out_image_size);
+	out_report.actual.cube_size = cube_size;
+	out_report.actual.cell_count = (double)volume.count();
+	out_report.actual.memory_size = (double)volume.memory_size();
+	out_report.actual.seconds = __seconds_since(carve_start);
+
+	return true;
+}
+
+// reconstuct point cloud
+rc::PointCloud reconstruct_point_cloud(const String image_path, Size& out_image_size, rc::Lattice& out_lattice, rc::NormalSet& out_normal_set, BudgetReport& out_report, const int level_count, PreviewCallback publish_preview)
+{
+	RC_TRACE_SCOPE("reconstruct_point_cloud");
+
+	ModelVolume volume;
+	if (!reconstruct_volume(image_path, out_image_size, volume, out_lattice, out_report, level_count, publish_preview)) return rc::PointCloud();
+
+	auto extract_start = chrono::steady_clock::now();
+	rc::PointCloud vertices_point_cloud;
+	rc::find_surface_vertices(volume, vertices_point_cloud, out_normal_set);
+
+	out_report.actual.face_count = (double)out_normal_set.size();
+	out_report.actual.seconds += __seconds_since(extract_start);
 
 	return vertices_point_cloud;
 }
 
+// write the compact model & the status of a preview level, the final level overwrites them.
+// previews skip the ascii stl, it takes longer to write than the next level to carve
+void publish_preview_output(const vector<uint8_t>& compact_mesh, const int cube_size, const string output_path, const ProgressiveLevel& progress)
+{
+	RC_TRACE_SCOPE("publish_preview_output");
+
+	string output_file_path = string(output_path + "\\model.mbm");
+	bool written = mbm::write_mesh_file(compact_mesh, output_file_path);
+
+	BudgetReport report;
+	report.actual.cube_size = cube_size;
+	generate_result_status(written, written ? output_file_path : "", output_path, report, progress);
+}
+
+// read the budget of a job, e.g. { "seconds": 30, "memory_mb": 512, "triangles": 200000 }, false without budget.json
+bool read_budget_file(const string image_path, rc::CarvingBudget& out_budget)
+{
+	ifstream ifs(image_path + "\\budget.json");
+	if (!ifs) return false;
+
+	string json((istreambuf_iterator<char>(ifs)), istreambuf_iterator<char>());
+	rapidjson::Document document;
+	if (document.Parse(json.c_str()).HasParseError() || !document.IsObject()) return false;
+
+	if (document.HasMember("seconds") && document["seconds"].IsNumber()) out_budget.seconds = document["seconds"].GetDouble();
+	if (document.HasMember("memory_mb") && document["memory_mb"].IsNumber()) out_budget.memory_size = document["memory_mb"].GetDouble() * 1024 * 1024;
+	if (document.HasMember("triangles") && document["triangles"].IsNumber()) out_budget.triangle_count = document["triangles"].GetDouble();
+
+	return true;
+}
+
+// read the printer of a slice job, e.g. { "resolution_x": 2560, "resolution_y": 1620, "pixel_size_mm": 0.05,
+// "layer_height_mm": 0.05, "model_height_mm": 50 }, the default printer without printer.json & false when it is malformed
+bool read_printer_file(const string image_path, slice::PrinterProfile& out_profile)
+{
+	ifstream ifs(image_path + "\\printer.json");
+	if (!ifs) return true;
+
+	string json((istreambuf_iterator<char>(ifs)), istreambuf_iterator<char>());
+	rapidjson::Document document;
+	if (document.Parse(json.c_str()).HasParseError() || !document.IsObject()) return false;
+
+	if (document.HasMember("resolution_x") && document["resolution_x"].IsNumber()) out_profile.resolution_x = (int)document["resolution_x"].GetDouble();
+	if (document.HasMember("resolution_y") && document["resolution_y"].IsNumber()) out_profile.resolution_y = (int)document["resolution_y"].GetDouble();
+	if (document.HasMember("pixel_size_mm") && document["pixel_size_mm"].IsNumber()) out_profile.pixel_size = document["pixel_size_mm"].GetDouble();
+	if (document.HasMember("layer_height_mm") && document["layer_height_mm"].IsNumber()) out_profile.layer_height = document["layer_height_mm"].GetDouble();
+	if (document.HasMember("model_height_mm") && document["model_height_mm"].IsNumber()) out_profile.model_height = document["model_height_mm"].GetDouble();
+
+	return true;
+}
+
+// read the island filter of a job, e.g. { "keep_largest": true, "min_cells": 20 }, false without islands.json.
+// without it every component of the carved volume is kept
+bool read_island_file(const string image_path, rc::IslandFilter& out_filter)
+{
+	ifstream ifs(image_path + "\\islands.json");
+	if (!ifs) return false;
+
+	string json((istreambuf_iterator<char>(ifs)), istreambuf_iterator<char>());
+	rapidjson::Document document;
+	if (document.Parse(json.c_str()).HasParseError() || !document.IsObject()) return false;
+
+	if (document.HasMember("keep_largest") && document["keep_largest"].IsBool()) out_filter.keep_largest = document["keep_largest"].GetBool();
+	if (document.HasMember("min_cells") && document["min_cells"].IsNumber()) out_filter.min_cell_count = (size_t)max(document["min_cells"].GetDouble(), 0.0);
+
+	return true;
+}
+
+// estimate from the coarsest decode, the silhouette areas & perimeters barely change with the resolution
+int select_budget_cube_size(const rc::ImageSrcSet& image_src_set, BudgetReport& report)
+{
+	RC_TRACE_SCOPE("select_budget_cube_size");
+
+	const int measure_scale = 8;
+
+	rc::ImageSet image_set;
+	rc::decode_image_set(image_src_set, image_set, measure_scale);
+
+	rc::ShapeSet shape_set;
+	rc::extract_shape(image_set, shape_set);
+
+	rc::OthProjection oth_proj;
+	rc::create_othogonal_projection(shape_set, oth_proj, measure_scale, rc::read_image_size(image_src_set));
+
+	rc::ProjectionMeasure measure;
+	rc::measure_projection(oth_proj, measure);
+
+	report.enabled = true;
+	return rc::select_cube_size(measure, report.budget, report.estimate);
+}
+
+// memory of the surface buffers & meshes, the volume is measured by the caller before it is freed
+double measure_model_memory(const rc::PointCloud& point_cloud, const rc::NormalSet& normal_set, const rc::WorldPointCloud& mapped_point_cloud, const mesh::LodSet& lod_set)
+{
+	double memory_size = (double)point_cloud.capacity() * sizeof(rc::LatticePoint)
+		+ (double)normal_set.capacity() * sizeof(rc::Normal)
+		+ (double)mapped_point_cloud.capacity() * sizeof(Point3f);
+
+	for (const auto& lod : lod_set)
+	{
+		memory_size += (double)lod.vertices.capacity() * sizeof(Point3f)
+			+ (double)lod.triangles.capacity() * sizeof(Vec3i)
+			+ (double)lod.normals.capacity() * sizeof(Point3f);
+	}
+
+	return memory_size;
+}
+
+double __seconds_since(const chrono::steady_clock::time_point start)
+{
+	return chrono::duration<double>(chrono::steady_clock::now() - start).count();
+}
+
 // generate the output file
-string generate_output_file(const rc::PointCloud point_cloud, const rc::NormalSet normal_set, const string output_path)
+string generate_output_file(const rc::WorldPointCloud& point_cloud, const rc::NormalSet normal_set, const string output_path)
 {
+	RC_TRACE_SCOPE("generate_output_file");
+
 	string path = string(output_path + "\\model.stl");
 	ofstream ofs(path);
 
@@ -145,15 +753,168 @@ string generate_output_file(const rc::PointCloud point_cloud, const rc::NormalSe
 	return path;
 }
 
+// generate the output file of a level of detail
+string generate_lod_output_file(const mesh::Mesh& mesh, const int level, const string output_path)
+{
+	RC_TRACE_SCOPE("generate_lod_output_file");
+
+	string path = string(output_path + "\\model_lod" + to_string(level) + ".stl");
+	ofstream ofs(path);
+
+	ofs << "solid model_lod" << level << endl;
+
+	for (auto triangle_idx = 0; triangle_idx < mesh.triangles.size(); triangle_idx++)
+	{
+		auto& normal = mesh.normals[triangle_idx];
+		ofs << "facet normal " << normal.x << " " << normal.y << " " << normal.z << endl;
+		ofs << "outer loop" << endl;
+
+		for (auto i = 0; i < 3; i++)
+		{
+			auto& vertex = mesh.vertices[mesh.triangles[triangle_idx][i]];
+			ofs << "vertex " << vertex.x << " " << vertex.y << " " << vertex.z << endl;
+		}
+
+		ofs << "endloop" << endl;
+		ofs << "endfacet" << endl;
+	}
+
+	ofs << "endsolid model_lod" << level << endl;
+
+	ofs.close();
+
+	return path;
+}
+
+// write the lattice surface in the compact mesh format, the lattice indices are stored as is
+// & the header carries the same lattice to window mapping as map_point_cloud_coordinate
+string generate_compact_output_file(const rc::PointCloud& point_cloud, const rc::NormalSet& normal_set, const rc::Lattice& lattice, const Size image_size, const Size window_size, const string output_path)
+{
+	RC_TRACE_SCOPE("generate_compact_output_file");
+
+	string path = string(output_path + "\\model.mbm");
+	mbm::write_mesh_file(encode_compact_mesh(point_cloud, normal_set, lattice, image_size, window_size), path);
+
+	return path;
+}
+
+vector<uint8_t> encode_compact_mesh(const rc::PointCloud& point_cloud, const rc::NormalSet& normal_set, const rc::Lattice& lattice, const Size image_size, const Size window_size)
+{
+	float window_scale = (float)(image_size.width / window_size.width) / window_size.width;
+
+	vector<uint8_t> data;
+	mbm::encode_mesh(
+		point_cloud,
+		normal_set,
+		window_scale * lattice.cube_size,
+		Point3f(window_scale * lattice.origin.x, window_scale * lattice.origin.y, window_scale * lattice.origin.z),
+		data
+	);
+
+	return data;
+}
+
+// write the printer layers of the volume, empty when the volume has no cells or a layer failed to encode
+string generate_slice_output_file(const ModelVolume& volume, const slice::PrinterProfile& profile, const string output_path)
+{
+	RC_TRACE_SCOPE("generate_slice_output_file");
+
+	string path = string(output_path + "\\model.zip");
+
+	vector<vector<uint8_t>> layer_images;
+	if (!slice::slice_volume(volume, profile, layer_images) || !slice::write_slice_archive(layer_images, profile, path)) return string();
+
+	return path;
+}
+
+// copy the encoded model into a pagefile backed mapping, the bytes are a complete .mbm image
+bool create_shared_mesh(const vector<uint8_t>& data, const string name, SharedMesh& out_shared_mesh)
+{
+	RC_TRACE_SCOPE("create_shared_mesh");
+
+	if (data.empty()) return false;
+
+	auto size = (unsigned long long)data.size();
+	HANDLE mapping = CreateFileMappingA(INVALID_HANDLE_VALUE, NULL, PAGE_READWRITE, (DWORD)(size >> 32), (DWORD)(size & 0xFFFFFFFF), name.c_str());
+	if (mapping == NULL) return false;
+
+	auto view = MapViewOfFile(mapping, FILE_MAP_WRITE, 0, 0, data.size());
+	if (view == NULL)
+	{
+		CloseHandle(mapping);
+		return false;
+	}
+
+	memcpy(view, data.data(), data.size());
+
+	out_shared_mesh.name = name;
+	out_shared_mesh.size = data.size();
+	out_shared_mesh.mapping = mapping;
+	out_shared_mesh.view = view;
+	return true;
+}
+
+void release_shared_mesh(SharedMesh& shared_mesh)
+{
+	if (shared_mesh.view != NULL) UnmapViewOfFile(shared_mesh.view);
+	if (shared_mesh.mapping != NULL) CloseHandle(shared_mesh.mapping);
+	shared_mesh = SharedMesh();
+}
+
 // generate the status json file for GUI
-void generate_result_status(const bool status, const string result_path, const string output_path)
+void generate_result_status(const bool status, const string result_path, const string output_path, const BudgetReport& report, const ProgressiveLevel& progress, const SharedMesh& shared_mesh, const bool files_written)
 {
 	rapidjson::Document document;
 	rapidjson::Document::AllocatorType& allocator = document.GetAllocator();
 	rapidjson::Value root(rapidjson::kObjectType);
-	root.AddMember("status", true, allocator);
+	root.AddMember("status", status, allocator);
 	root.AddMember("path", rapidjson::Value(result_path.c_str(), allocator), allocator);
 
+	if (report.actual.cube_size > 0)
+	{
+		root.AddMember("cube_size", report.actual.cube_size, allocator);
+	}
+
+	if (progress.level_count > 1)
+	{
+		root.AddMember("level", progress.level, allocator);
+		root.AddMember("level_count", progress.level_count, allocator);
+		root.AddMember("final", progress.level + 1 == progress.level_count, allocator);
+	}
+
+	// files_written turns true once path points at a finished file
+	if (!shared_mesh.name.empty())
+	{
+		rapidjson::Value shared_memory(rapidjson::kObjectType);
+		shared_memory.AddMember("name", rapidjson::Value(shared_mesh.name.c_str(), allocator), allocator);
+		shared_memory.AddMember("size", (uint64_t)shared_mesh.size, allocator);
+		shared_memory.AddMember("format", "mbm", allocator);
+		shared_memory.AddMember("version", mbm::file_version, allocator);
+		root.AddMember("shared_memory", shared_memory, allocator);
+		root.AddMember("files_written", files_written, allocator);
+	}
+
+	if (report.enabled)
+	{
+		rapidjson::Value budget(rapidjson::kObjectType);
+		budget.AddMember("seconds", report.budget.seconds, allocator);
+		budget.AddMember("memory", report.budget.memory_size, allocator);
+		budget.AddMember("triangles", report.budget.triangle_count, allocator);
+		root.AddMember("budget", budget, allocator);
+
+		root.AddMember("estimate", __carving_estimate_value(report.estimate, allocator), allocator);
+		root.AddMember("actual", __carving_estimate_value(report.actual, allocator), allocator);
+
+		// relative error of the estimate, positive when it overestimated
+		auto relative_error = [](double estimate, double actual) { return actual > 0 ? (estimate - actual) / actual : 0.0; };
+		rapidjson::Value error(rapidjson::kObjectType);
+		error.AddMember("cells", relative_error(report.estimate.cell_count, report.actual.cell_count), allocator);
+		error.AddMember("faces", relative_error(report.estimate.face_count, report.actual.face_count), allocator);
+		error.AddMember("memory", relative_error(report.estimate.memory_size, report.actual.memory_size), allocator);
+		error.AddMember("seconds", relative_error(report.estimate.seconds, report.actual.seconds), allocator);
+		root.AddMember("error", error, allocator);
+	}
+
 	rapidjson::StringBuffer buffer;
 	rapidjson::Writer<rapidjson::StringBuffer> writer(buffer);
 	root.Accept(writer);
@@ -163,13 +924,27 @@ void generate_result_status(const bool status, const string result_path, const s
 	ofs.close();
 }
 
-// map point cloud coordinate to opengl form
-rc::PointCloud map_point_cloud_coordinate(const rc::PointCloud point_cloud, const Size image_size, const Size window_size)
+rapidjson::Value __carving_estimate_value(const rc::CarvingEstimate& estimate, rapidjson::Document::AllocatorType& allocator)
 {
-	rc::PointCloud mapped_point_cloud;
+	rapidjson::Value value(rapidjson::kObjectType);
+	value.AddMember("cube_size", estimate.cube_size, allocator);
+	value.AddMember("cells", estimate.cell_count, allocator);
+	value.AddMember("faces", estimate.face_count, allocator);
+	value.AddMember("triangles", 2 * estimate.face_count, allocator);
+	value.AddMember("memory", estimate.memory_size, allocator);
+	value.AddMember("seconds", estimate.seconds, allocator);
+	return value;
+}
+
+// map point cloud coordinate to opengl form, the lattice points only become floats here
+rc::WorldPointCloud map_point_cloud_coordinate(const rc::PointCloud& point_cloud, const rc::Lattice& lattice, const Size image_size, const Size window_size)
+{
+	rc::WorldPointCloud mapped_point_cloud;
+	mapped_point_cloud.reserve(point_cloud.size());
 
-	for (auto p : point_cloud)
+	for (auto point : point_cloud)
 	{
+		auto p = rc::get_world_point(point, lattice);
 		mapped_point_cloud.push_back(
 			Point3f(
 				image_size.width / window_size.width * p.x / window_size.width,
@@ -182,6 +957,51 @@ rc::PointCloud map_point_cloud_coordinate(const rc::PointCloud point_cloud, cons
 	return mapped_point_cloud;
 }
 
+// map the mesh file & decode the mapped bytes straight into the draw buffers
+bool load_view_mesh(const string path, mbm::GpuMesh& out_mesh)
+{
+	HANDLE file = CreateFileA(path.c_str(), GENERIC_READ, FILE_SHARE_READ, NULL, OPEN_EXISTING, FILE_FLAG_SEQUENTIAL_SCAN, NULL);
+	if (file == INVALID_HANDLE_VALUE) return false;
+
+	LARGE_INTEGER file_size;
+	if (!GetFileSizeEx(file, &file_size) || file_size.QuadPart == 0)
+	{
+		CloseHandle(file);
+		return false;
+	}
+
+	HANDLE mapping = CreateFileMappingA(file, NULL, PAGE_READONLY, 0, 0, NULL);
+	CloseHandle(file);
+	if (mapping == NULL) return false;
+
+	auto data = (const uint8_t*)MapViewOfFile(mapping, FILE_MAP_READ, 0, 0, 0);
+	CloseHandle(mapping);
+	if (data == NULL) return false;
+
+	bool loaded = mbm::decode_mesh(data, (size_t)file_size.QuadPart, out_mesh) ||
+		mbm::decode_binary_stl(data, (size_t)file_size.QuadPart, out_mesh);
+
+	UnmapViewOfFile(data);
+	return loaded;
+}
+
+// draw the buffers with vertex arrays, no per vertex calls
+void draw_view_mesh(const mbm::GpuMesh& mesh)
+{
+	glFrontFace(GL_CCW);
+	glColor4d(.4, .6, .93, 1);
+
+	glEnableClientState(GL_VERTEX_ARRAY);
+	glEnableClientState(GL_NORMAL_ARRAY);
+	glVertexPointer(3, GL_FLOAT, 0, mesh.positions.data());
+	glNormalPointer(GL_FLOAT, 0, mesh.normals.data());
+	glDrawElements(GL_TRIANGLES, (GLsizei)mesh.indices.size(), GL_UNSIGNED_INT, mesh.indices.data());
+	glDisableClientState(GL_NORMAL_ARRAY);
+	glDisableClientState(GL_VERTEX_ARRAY);
+
+	glFrontFace(GL_CW);
+}
+
 // init opengl
 void render_model(int argc, char** argv, Size window_size, function<void()> draw_callback)
 {
@@ -209,6 +1029,8 @@ void render_model(int argc, char** argv, Size window_size, function<void()> draw
 	__init_perspective_view(window_size.width, window_size.height);
 	__init_lighting();
 
+	// closing the window returns from the loop instead of calling exit, so the caller can finish its writes
+	glutSetOption(GLUT_ACTION_ON_WINDOW_CLOSE, GLUT_ACTION_GLUTMAINLOOP_RETURNS);
 	glutMainLoop();
 }
 
@@ -333,4 +1155,13 @@ void __motion(int x, int y)
 	__controller.mouse_x = x;
 	__controller.mouse_y = y;
 	glutPostRedisplay();
-}
\ No newline at end of file
+}
+
+bool __has_argument(int argc, char* argv[], const string name)
+{
+	for (auto arg_idx = 1; arg_idx < argc; arg_idx++)
+	{
+		if (name == argv[arg_idx]) return true;
+	}
+	return false;
+}
@@ -0,0 +1,293 @@
+#pragma once
+#ifndef MBM_H
+#define MBM_H
+
+#include <cstdint>
+#include <cstring>
+#include <fstream>
+#include <unordered_map>
+#include "rc.h"
+
+using namespace std;
+
+// compact mesh format (.mbm) of the lattice surface, little endian:
+//   header
+//   vertices      vertex_count * 3 * uint16, lattice indices in the order of first use
+//   normal codes  3 bits per quad, packed from the lowest bit of the first byte
+//   indices       4 per quad, zigzag varint of the difference to the previous index
+// world position = position_offset + position_scale * lattice index
+namespace mbm
+{
+#pragma region type_declaration
+
+	const char file_magic[4] = { 'M', 'B', 'M', '\0' };
+	const uint16_t file_version = 1;
+
+#pragma pack(push, 1)
+	struct Header
+	{
+		char magic[4];
+		uint16_t version;
+		uint16_t header_size;
+		uint32_t vertex_count;
+		uint32_t quad_count;
+		uint32_t index_data_size;
+		float position_scale;
+		float position_offset[3];
+	};
+#pragma pack(pop)
+
+	// axis-aligned face normals, the 3-bit code stored per quad
+	enum NormalCode : uint8_t
+	{
+		positive_x = 0, negative_x, positive_y, negative_y, positive_z, negative_z
+	};
+
+	// flat shaded, 4 unshared vertices per quad & 2 triangles per quad,
+	// ready for glVertexPointer / glNormalPointer / glDrawElements
+	struct GpuMesh
+	{
+		vector<float> positions; // x, y, z per vertex
+		vector<float> normals; // x, y, z per vertex
+		vector<uint32_t> indices; // 6 per quad
+	};
+
+#pragma endregion
+
+#pragma region methods_declaration
+
+	void encode_mesh(const rc::PointCloud& point_cloud, const rc::NormalSet& normal_set, const float position_scale, const Point3f position_offset, vector<uint8_t>& out_data);
+	bool decode_mesh(const uint8_t* data, const size_t data_size, GpuMesh& out_mesh);
+	bool write_mesh_file(const vector<uint8_t>& data, const string path);
+	bool decode_binary_stl(const uint8_t* data, const size_t data_size, GpuMesh& out_mesh);
+	NormalCode __encode_normal(const rc::Normal& normal);
+	Point3f __decode_normal(const uint8_t code);
+	void __write_varint(uint32_t value, vector<uint8_t>& out_data);
+	bool __read_varint(const uint8_t*& data, const uint8_t* data_end, uint32_t& out_value);
+
+#pragma endregion
+
+#pragma region methods_definition
+
+	// weld & pack the surface quads (4 lattice points per face, one normal per face)
+	void encode_mesh(const rc::PointCloud& point_cloud, const rc::NormalSet& normal_set, const float position_scale, const Point3f position_offset, vector<uint8_t>& out_data)
+	{
+		auto quad_count = min(point_cloud.size() / 4, normal_set.size());
+
+		unordered_map<rc::MortonKey, uint32_t> vertex_index;
+		vector<rc::LatticePoint> vertices;
+		vector<uint32_t> indices;
+		indices.reserve(quad_count * 4);
+
+		for (size_t point_idx = 0; point_idx < quad_count * 4; point_idx++)
+		{
+			auto& point = point_cloud[point_idx];
+			auto found = vertex_index.emplace(rc::encode_morton_key(point), (uint32_t)vertices.size());
+			if (found.second) vertices.push_back(point);
+			indices.push_back(found.first->second);
+		}
+
+		vector<uint8_t> normal_data((quad_count * 3 + 7) / 8, 0);
+		for (size_t quad_idx = 0; quad_idx < quad_count; quad_idx++)
+		{
+			auto code = __encode_normal(normal_set[quad_idx]);
+			for (auto bit = 0; bit < 3; bit++)
+			{
+				auto bit_idx = quad_idx * 3 + bit;
+				if (code & (1 << bit)) normal_data[bit_idx / 8] |= 1 << (bit_idx % 8);
+			}
+		}
+
+		// neighbouring quads share most of their vertices, so the differences stay small
+		vector<uint8_t> index_data;
+		int64_t previous_idx = 0;
+		for (auto idx : indices)
+		{
+			auto delta = (int32_t)((int64_t)idx - previous_idx);
+			__write_varint(((uint32_t)delta << 1) ^ (uint32_t)(delta >> 31), index_data);
+			previous_idx = idx;
+		}
+
+		Header header;
+		memcpy(header.magic, file_magic, sizeof(file_magic));
+		header.version = file_version;
+		header.header_size = sizeof(Header);
+		header.vertex_count = (uint32_t)vertices.size();
+		header.quad_count = (uint32_t)quad_count;
+		header.index_data_size = (uint32_t)index_data.size();
+		header.position_scale = position_scale;
+		header.position_offset[0] = position_offset.x;
+		header.position_offset[1] = position_offset.y;
+		header.position_offset[2] = position_offset.z;
+
+		out_data.resize(sizeof(Header) + vertices.size() * 3 * sizeof(uint16_t) + normal_data.size() + index_data.size());
+		auto write_ptr = out_data.data();
+
+		memcpy(write_ptr, &header, sizeof(Header));
+		write_ptr += sizeof(Header);
+
+		for (const auto& vertex : vertices)
+		{
+			uint16_t position[3] = { vertex.x, vertex.y, vertex.z };
+			memcpy(write_ptr, position, sizeof(position));
+			write_ptr += sizeof(position);
+		}
+
+		if (!normal_data.empty()) memcpy(write_ptr, normal_data.data(), normal_data.size());
+		write_ptr += normal_data.size();
+
+		if (!index_data.empty()) memcpy(write_ptr, index_data.data(), index_data.size());
+	}
+
+	// decode a whole file image (e.g. a mapped view) into vertex & index buffers
+	bool decode_mesh(const uint8_t* data, const size_t data_size, GpuMesh& out_mesh)
+	{
+		if (data_size < sizeof(Header)) return false;
+
+		Header header;
+		memcpy(&header, data, sizeof(Header));
+		if (memcmp(header.magic, file_magic, sizeof(file_magic)) != 0 || header.version > file_version || header.header_size < sizeof(Header)) return false;
+
+		auto vertex_data_size = (size_t)header.vertex_count * 3 * sizeof(uint16_t);
+		auto normal_data_size = ((size_t)header.quad_count * 3 + 7) / 8;
+		if (data_size < (size_t)header.header_size + vertex_data_size + normal_data_size + header.index_data_size) return false;
+
+		auto vertex_data = data + header.header_size;
+		auto normal_data = vertex_data + vertex_data_size;
+		auto index_data = normal_data + normal_data_size;
+		auto index_data_end = index_data + header.index_data_size;
+
+		out_mesh.positions.resize((size_t)header.quad_count * 4 * 3);
+		out_mesh.normals.resize((size_t)header.quad_count * 4 * 3);
+		out_mesh.indices.resize((size_t)header.quad_count * 6);
+
+		auto positions = out_mesh.positions.data();
+		auto normals = out_mesh.normals.data();
+		auto indices = out_mesh.indices.data();
+
+		int64_t idx = 0;
+		for (size_t quad_idx = 0; quad_idx < header.quad_count; quad_idx++)
+		{
+			uint8_t code = 0;
+			for (auto bit = 0; bit < 3; bit++)
+			{
+				auto bit_idx = quad_idx * 3 + bit;
+				if (normal_data[bit_idx / 8] & (1 << (bit_idx % 8))) code |= 1 << bit;
+			}
+			auto normal = __decode_normal(code);
+
+			for (auto i = 0; i < 4; i++)
+			{
+				uint32_t zigzag;
+				if (!__read_varint(index_data, index_data_end, zigzag)) return false;
+
+				idx += (int32_t)(zigzag >> 1) ^ -(int32_t)(zigzag & 1);
+				if (idx < 0 || idx >= header.vertex_count) return false;
+
+				uint16_t position[3];
+				memcpy(position, vertex_data + idx * sizeof(position), sizeof(position));
+
+				auto vertex_idx = quad_idx * 4 + i;
+				for (auto axis = 0; axis < 3; axis++)
+				{
+					positions[vertex_idx * 3 + axis] = header.position_offset[axis] + header.position_scale * position[axis];
+				}
+				normals[vertex_idx * 3] = normal.x;
+				normals[vertex_idx * 3 + 1] = normal.y;
+				normals[vertex_idx * 3 + 2] = normal.z;
+			}
+
+			// same split as the stl output
+			auto first_idx = (uint32_t)(quad_idx * 4);
+			uint32_t triangles[6] = { first_idx, first_idx + 1, first_idx + 2, first_idx + 2, first_idx + 3, first_idx };
+			memcpy(indices + quad_idx * 6, triangles, sizeof(triangles));
+		}
+
+		return true;
+	}
+
+	bool write_mesh_file(const vector<uint8_t>& data, const string path)
+	{
+		ofstream ofs(path, ios::binary);
+		ofs.write((const char*)data.data(), data.size());
+		return ofs.good();
+	}
+
+	// binary stl: 80 byte header, triangle count & 50 bytes per triangle (normal, 3 vertices, attribute)
+	bool decode_binary_stl(const uint8_t* data, const size_t data_size, GpuMesh& out_mesh)
+	{
+		const size_t header_size = 84, triangle_size = 50;
+		if (data_size < header_size) return false;
+
+		uint32_t triangle_count;
+		memcpy(&triangle_count, data + 80, sizeof(triangle_count));
+
+		// ascii stl starts with "solid" too, so only trust the size
+		if (data_size != header_size + (size_t)triangle_count * triangle_size) return false;
+
+		out_mesh.positions.resize((size_t)triangle_count * 9);
+		out_mesh.normals.resize((size_t)triangle_count * 9);
+		out_mesh.indices.resize((size_t)triangle_count * 3);
+
+		auto triangle_data = data + header_size;
+		for (size_t triangle_idx = 0; triangle_idx < triangle_count; triangle_idx++, triangle_data += triangle_size)
+		{
+			float normal[3];
+			memcpy(normal, triangle_data, sizeof(normal));
+			memcpy(&out_mesh.positions[triangle_idx * 9], triangle_data + sizeof(normal), 9 * sizeof(float));
+
+			for (auto i = 0; i < 3; i++)
+			{
+				memcpy(&out_mesh.normals[(triangle_idx * 3 + i) * 3], normal, sizeof(normal));
+				out_mesh.indices[triangle_idx * 3 + i] = (uint32_t)(triangle_idx * 3 + i);
+			}
+		}
+
+		return true;
+	}
+
+	NormalCode __encode_normal(const rc::Normal& normal)
+	{
+		if (normal.x != 0) return normal.x > 0 ? positive_x : negative_x;
+		if (normal.y != 0) return normal.y > 0 ? positive_y : negative_y;
+		return normal.z > 0 ? positive_z : negative_z;
+	}
+
+	Point3f __decode_normal(const uint8_t code)
+	{
+		static const Point3f normals[8] = {
+			Point3f(1, 0, 0), Point3f(-1, 0, 0),
+			Point3f(0, 1, 0), Point3f(0, -1, 0),
+			Point3f(0, 0, 1), Point3f(0, 0, -1),
+			Point3f(0, 0, 0), Point3f(0, 0, 0)
+		};
+		return normals[code & 7];
+	}
+
+	// 7 bits per byte, the high bit marks a following byte
+	void __write_varint(uint32_t value, vector<uint8_t>& out_data)
+	{
+		while (value >= 0x80)
+		{
+			out_data.push_back((uint8_t)(value | 0x80));
+			value >>= 7;
+		}
+		out_data.push_back((uint8_t)value);
+	}
+
+	bool __read_varint(const uint8_t*& data, const uint8_t* data_end, uint32_t& out_value)
+	{
+		out_value = 0;
+		for (auto shift = 0; shift < 35 && data < data_end; shift += 7)
+		{
+			auto byte = *data++;
+			out_value |= (uint32_t)(byte & 0x7F) << shift;
+			if (!(byte & 0x80)) return true;
+		}
+		return false;
+	}
+
+#pragma endregion
+}
+
+#endif // !MBM_H
@@ -0,0 +1,552 @@
+#pragma once
+#ifndef MESH_H
+#define MESH_H
+
+#include <opencv2/opencv.hpp>
+#include <cfloat>
+#include <map>
+#include <queue>
+#include <thread>
+#include <unordered_map>
+#include "rc.h"
+
+using namespace std;
+using namespace cv;
+
+namespace mesh
+{
+#pragma region type_declaration
+
+	struct Mesh
+	{
+		vector<Point3f> vertices;
+		vector<Vec3i> triangles;
+		vector<Point3f> normals; // one per triangle
+	};
+
+	typedef vector<Mesh> LodSet;
+
+	// error quadric of the planes around a vertex (symmetric 4x4 matrix)
+	struct Quadric
+	{
+		double a2 = 0, ab = 0, ac = 0, ad = 0, b2 = 0, bc = 0, bd = 0, c2 = 0, cd = 0, d2 = 0;
+
+		void add_plane(double a, double b, double c, double d, double weight = 1)
+		{
+			a2 += weight * a * a; ab += weight * a * b; ac += weight * a * c; ad += weight * a * d;
+			b2 += weight * b * b; bc += weight * b * c; bd += weight * b * d;
+			c2 += weight * c * c; cd += weight * c * d;
+			d2 += weight * d * d;
+		}
+
+		void add(const Quadric& q)
+		{
+			a2 += q.a2; ab += q.ab; ac += q.ac; ad += q.ad;
+			b2 += q.b2; bc += q.bc; bd += q.bd;
+			c2 += q.c2; cd += q.cd;
+			d2 += q.d2;
+		}
+
+		double evaluate(const Point3d& p) const
+		{
+			return a2 * p.x * p.x + 2 * ab * p.x * p.y + 2 * ac * p.x * p.z + 2 * ad * p.x
+				+ b2 * p.y * p.y + 2 * bc * p.y * p.z + 2 * bd * p.y
+				+ c2 * p.z * p.z + 2 * cd * p.z
+				+ d2;
+		}
+
+		// position with the minimum error, fails when the planes do not pin down a single point
+		bool optimize(Point3d& out_point) const
+		{
+			double det = a2 * (b2 * c2 - bc * bc) - ab * (ab * c2 - bc * ac) + ac * (ab * bc - b2 * ac);
+			if (fabs(det) < 1e-9) return false;
+
+			out_point.x = -(ad * (b2 * c2 - bc * bc) - ab * (bd * c2 - bc * cd) + ac * (bd * bc - b2 * cd)) / det;
+			out_point.y = -(a2 * (bd * c2 - cd * bc) - ad * (ab * c2 - bc * ac) + ac * (ab * cd - bd * ac)) / det;
+			out_point.z = -(a2 * (b2 * cd - bc * bd) - ab * (ab * cd - bd * ac) + ad * (ab * bc - b2 * ac)) / det;
+			return true;
+		}
+	};
+
+	struct EdgeCollapse
+	{
+		double cost;
+		int u, v;
+		unsigned u_version, v_version;
+		Point3d position;
+
+		bool operator>(const EdgeCollapse& other) const { return cost > other.cost; }
+	};
+
+	// shared state of a decimation, partitions only touch their own unlocked vertices
+	// and the triangles around them, so they can collapse edges concurrently
+	struct DecimationState
+	{
+		vector<Point3d> positions;
+		vector<Quadric> quadrics;
+		vector<vector<int>> vertex_triangles;
+		vector<unsigned> versions;
+		vector<char> removed_vertices;
+		vector<int> partitions;
+		vector<char> locked;
+
+		vector<Vec3i> triangles;
+		vector<char> removed_triangles;
+	};
+
+#pragma endregion
+
+#pragma region methods_declaration
+
+	void create_mesh(const rc::PointCloud& lattice_point_cloud, const rc::WorldPointCloud& point_cloud, Mesh& out_mesh);
+	void compute_normals(Mesh& mesh);
+	void decimate(const Mesh& mesh, Mesh& out_mesh, const size_t target_triangle_count, const double max_error = DBL_MAX, const int partition_count = thread::hardware_concurrency());
+	void generate_lod_set(const Mesh& mesh, LodSet& out_lod_set, const int level_count = 4, const double reduction = .25, const int partition_count = thread::hardware_concurrency());
+	void __init_decimation_state(const Mesh& mesh, DecimationState& out_state);
+	void __partition_vertices(DecimationState& state, const int partition_count, const double offset);
+	size_t __decimate_partition(DecimationState& state, const int partition, const size_t remove_count, const double max_error);
+	bool __find_collapse(const DecimationState& state, const int u, const int v, EdgeCollapse& out_collapse);
+	bool __can_collapse(const DecimationState& state, const int u, const int v, const Point3d& position);
+	void __collapse_edge(DecimationState& state, const int u, const int v, const Point3d& position);
+	Point3d __triangle_normal(const Point3d& p0, const Point3d& p1, const Point3d& p2);
+
+#pragma endregion
+
+#pragma region methods_definition
+
+	// weld the quads (4 vertices per face) of a surface point cloud into an indexed triangle mesh,
+	// point_cloud holds the world positions of the lattice points, which are exact keys for the weld
+	void create_mesh(const rc::PointCloud& lattice_point_cloud, const rc::WorldPointCloud& point_cloud, Mesh& out_mesh)
+	{
+		RC_TRACE_SCOPE("create_mesh");
+
+		auto point_count = min(lattice_point_cloud.size(), point_cloud.size());
+
+		unordered_map<rc::MortonKey, int> vertex_index;
+		vertex_index.reserve(point_count / 2);
+		vector<int> quad(4);
+
+		for (size_t start_idx = 0; start_idx + 3 < point_count; start_idx += 4)
+		{
+			for (auto i = 0; i < 4; i++)
+			{
+				auto found = vertex_index.emplace(rc::encode_morton_key(lattice_point_cloud[start_idx + i]), (int)out_mesh.vertices.size());
+				if (found.second) out_mesh.vertices.push_back(point_cloud[start_idx + i]);
+				quad[i] = found.first->second;
+			}
+
+			// same split as the stl output
+			out_mesh.triangles.push_back(Vec3i(quad[0], quad[1], quad[2]));
+			out_mesh.triangles.push_back(Vec3i(quad[2], quad[3], quad[0]));
+		}
+
+		compute_normals(out_mesh);
+	}
+
+	// compute the face normals from the winding
+	void compute_normals(Mesh& mesh)
+	{
+		mesh.normals.resize(mesh.triangles.size());
+
+		for (size_t i = 0; i < mesh.triangles.size(); i++)
+		{
+			auto& t = mesh.triangles[i];
+			Point3d normal = __triangle_normal(mesh.vertices[t[0]], mesh.vertices[t[1]], mesh.vertices[t[2]]);
+			double length = sqrt(normal.dot(normal));
+			mesh.normals[i] = length > 0 ? Point3f(normal.x / length, normal.y / length, normal.z / length) : Point3f(0, 0, 0);
+		}
+	}
+
+	// quadric error edge collapse down to the target triangle count or error bound,
+	// the mesh is split into slabs that are decimated in parallel, followed by passes
+	// over the shifted slab borders and finally the whole mesh
+	void decimate(const Mesh& mesh, Mesh& out_mesh, const size_t target_triangle_count, const double max_error, const int partition_count)
+	{
+		RC_TRACE_SCOPE("decimate");
+
+		DecimationState state;
+		__init_decimation_state(mesh, state);
+
+		size_t triangle_count = mesh.triangles.size();
+		vector<pair<int, double>> passes = { { max(partition_count, 1), 0 }, { max(partition_count, 1), .5 }, { 1, 0 } };
+
+		for (const auto& pass : passes)
+		{
+			if (triangle_count <= target_triangle_count) break;
+
+			__partition_vertices(state, pass.first, pass.second);
+
+			// every partition removes the same share of its own triangles
+			vector<size_t> partition_triangle_count(pass.first, 0);
+			for (size_t t = 0; t < state.triangles.size(); t++)
+			{
+				if (!state.removed_triangles[t]) partition_triangle_count[state.partitions[state.triangles[t][0]]]++;
+			}
+
+			double remove_ratio = 1 - (double)target_triangle_count / triangle_count;
+			vector<size_t> removed_count(pass.first, 0);
+			vector<thread> threads;
+
+			for (auto partition = 0; partition < pass.first; partition++)
+			{
+				size_t remove_count = (size_t)ceil(partition_triangle_count[partition] * remove_ratio);
+				threads.emplace_back([&, partition, remove_count]()
+				{
+					removed_count[partition] = __decimate_partition(state, partition, remove_count, max_error);
+				});
+			}
+
+			for (auto& t : threads) t.join();
+			for (auto count : removed_count) triangle_count -= count;
+		}
+
+		// compact the surviving vertices & triangles
+		vector<int> vertex_map(state.positions.size(), -1);
+		for (size_t t = 0; t < state.triangles.size(); t++)
+		{
+			if (state.removed_triangles[t]) continue;
+
+			Vec3i triangle;
+			for (auto i = 0; i < 3; i++)
+			{
+				auto v = state.triangles[t][i];
+				if (vertex_map[v] < 0)
+				{
+					vertex_map[v] = (int)out_mesh.vertices.size();
+					out_mesh.vertices.push_back(Point3f(state.positions[v].x, state.positions[v].y, state.positions[v].z));
+				}
+				triangle[i] = vertex_map[v];
+			}
+			out_mesh.triangles.push_back(triangle);
+		}
+
+		compute_normals(out_mesh);
+	}
+
+	// level 0 is the full mesh, every further level keeps a share of the previous one
+	void generate_lod_set(const Mesh& mesh, LodSet& out_lod_set, const int level_count, const double reduction, const int partition_count)
+	{
+		out_lod_set.push_back(mesh);
+
+		for (auto level = 1; level < level_count; level++)
+		{
+			auto& previous = out_lod_set.back();
+			Mesh lod;
+			decimate(previous, lod, (size_t)(previous.triangles.size() * reduction), DBL_MAX, partition_count);
+
+			// stop once the mesh cannot be reduced any further
+			if (lod.triangles.size() >= previous.triangles.size()) break;
+			out_lod_set.push_back(move(lod));
+		}
+	}
+
+	// build the vertex quadrics & adjacency
+	void __init_decimation_state(const Mesh& mesh, DecimationState& out_state)
+	{
+		auto vertex_count = mesh.vertices.size();
+		out_state.positions.resize(vertex_count);
+		out_state.quadrics.resize(vertex_count);
+		out_state.vertex_triangles.resize(vertex_count);
+		out_state.versions.assign(vertex_count, 0);
+		out_state.removed_vertices.assign(vertex_count, false);
+		out_state.triangles = mesh.triangles;
+		out_state.removed_triangles.assign(mesh.triangles.size(), false);
+
+		for (size_t v = 0; v < vertex_count; v++)
+		{
+			out_state.positions[v] = Point3d(mesh.vertices[v].x, mesh.vertices[v].y, mesh.vertices[v].z);
+		}
+
+		map<pair<int, int>, int> edge_use;
+		for (size_t t = 0; t < mesh.triangles.size(); t++)
+		{
+			auto& triangle = mesh.triangles[t];
+			auto& p0 = out_state.positions[triangle[0]];
+			Point3d normal = __triangle_normal(p0, out_state.positions[triangle[1]], out_state.positions[triangle[2]]);
+			double length = sqrt(normal.dot(normal));
+			if (length > 0) normal = normal * (1 / length);
+
+			for (auto i = 0; i < 3; i++)
+			{
+				out_state.quadrics[triangle[i]].add_plane(normal.x, normal.y, normal.z, -normal.dot(p0));
+				out_state.vertex_triangles[triangle[i]].push_back((int)t);
+
+				auto a = triangle[i], b = triangle[(i + 1) % 3];
+				edge_use[make_pair(min(a, b), max(a, b))]++;
+			}
+		}
+
+		// keep open borders in place with a heavy plane perpendicular to the border triangle
+		for (size_t t = 0; t < mesh.triangles.size(); t++)
+		{
+			auto& triangle = mesh.triangles[t];
+			Point3d normal = __triangle_normal(out_state.positions[triangle[0]], out_state.positions[triangle[1]], out_state.positions[triangle[2]]);
+
+			for (auto i = 0; i < 3; i++)
+			{
+				auto a = triangle[i], b = triangle[(i + 1) % 3];
+				if (edge_use[make_pair(min(a, b), max(a, b))] != 1) continue;
+
+				Point3d edge = out_state.positions[b] - out_state.positions[a];
+				Point3d border_normal = edge.cross(normal);
+				double length = sqrt(border_normal.dot(border_normal));
+				if (length == 0) continue;
+				border_normal = border_normal * (1 / length);
+
+				double d = -border_normal.dot(out_state.positions[a]);
+				out_state.quadrics[a].add_plane(border_normal.x, border_normal.y, border_normal.z, d, 1000);
+				out_state.quadrics[b].add_plane(border_normal.x, border_normal.y, border_normal.z, d, 1000);
+			}
+		}
+	}
+
+	// split the vertices into slabs along the longest axis, vertices of triangles crossing a slab border are locked
+	void __partition_vertices(DecimationState& state, const int partition_count, const double offset)
+	{
+		Point3d min_point(DBL_MAX, DBL_MAX, DBL_MAX), max_point(-DBL_MAX, -DBL_MAX, -DBL_MAX);
+		for (size_t v = 0; v < state.positions.size(); v++)
+		{
+			if (state.removed_vertices[v]) continue;
+			auto& p = state.positions[v];
+			min_point = Point3d(min(min_point.x, p.x), min(min_point.y, p.y), min(min_point.z, p.z));
+			max_point = Point3d(max(max_point.x, p.x), max(max_point.y, p.y), max(max_point.z, p.z));
+		}
+
+		Point3d extent = max_point - min_point;
+		int axis = extent.x >= extent.y && extent.x >= extent.z ? 0 : extent.y >= extent.z ? 1 : 2;
+		double axis_min = axis == 0 ? min_point.x : axis == 1 ? min_point.y : min_point.z;
+		double axis_extent = axis == 0 ? extent.x : axis == 1 ? extent.y : extent.z;
+		double slab_size = axis_extent > 0 ? axis_extent / partition_count : 1;
+
+		state.partitions.assign(state.positions.size(), 0);
+		state.locked.assign(state.positions.size(), false);
+
+		for (size_t v = 0; v < state.positions.size(); v++)
+		{
+			auto& p = state.positions[v];
+			double coordinate = axis == 0 ? p.x : axis == 1 ? p.y : p.z;
+			int partition = (int)floor((coordinate - axis_min) / slab_size + offset);
+			state.partitions[v] = min(max(partition, 0), partition_count - 1);
+		}
+
+		for (size_t t = 0; t < state.triangles.size(); t++)
+		{
+			if (state.removed_triangles[t]) continue;
+
+			auto& triangle = state.triangles[t];
+			if (state.partitions[triangle[0]] != state.partitions[triangle[1]] || state.partitions[triangle[0]] != state.partitions[triangle[2]])
+			{
+				state.locked[triangle[0]] = state.locked[triangle[1]] = state.locked[triangle[2]] = true;
+			}
+		}
+	}
+
+	// collapse the cheapest edges of a partition, returns the number of removed triangles
+	size_t __decimate_partition(DecimationState& state, const int partition, const size_t remove_count, const double max_error)
+	{
+		RC_TRACE_SCOPE("decimate_partition");
+
+		// partition & lock are read-only during a pass, check them before touching state of other partitions
+		auto is_free = [&](int v) { return state.partitions[v] == partition && !state.locked[v] && !state.removed_vertices[v]; };
+
+		priority_queue<EdgeCollapse, vector<EdgeCollapse>, greater<EdgeCollapse>> queue;
+		vector<int> neighbours;
+		auto push_edges = [&](int u)
+		{
+			// every neighbour shows up in two triangles, queue its edge once
+			neighbours.clear();
+			for (auto t : state.vertex_triangles[u])
+			{
+				for (auto i = 0; i < 3; i++)
+				{
+					auto v = state.triangles[t][i];
+					if (v != u && is_free(v)) neighbours.push_back(v);
+				}
+			}
+			sort(neighbours.begin(), neighbours.end());
+			neighbours.erase(unique(neighbours.begin(), neighbours.end()), neighbours.end());
+
+			for (auto v : neighbours)
+			{
+				EdgeCollapse collapse;
+				if (__find_collapse(state, u, v, collapse)) queue.push(collapse);
+			}
+		};
+
+		for (size_t u = 0; u < state.positions.size(); u++)
+		{
+			if (is_free((int)u)) push_edges((int)u);
+		}
+
+		size_t removed_count = 0;
+		while (removed_count < remove_count && !queue.empty())
+		{
+			auto collapse = queue.top();
+			queue.pop();
+
+			if (collapse.cost > max_error) break;
+
+			// skip edges that changed since they were queued
+			if (state.removed_vertices[collapse.u] || state.removed_vertices[collapse.v]) continue;
+			if (state.versions[collapse.u] != collapse.u_version || state.versions[collapse.v] != collapse.v_version) continue;
+			if (!__can_collapse(state, collapse.u, collapse.v, collapse.position)) continue;
+
+			auto triangle_count = state.vertex_triangles[collapse.u].size() + state.vertex_triangles[collapse.v].size();
+			__collapse_edge(state, collapse.u, collapse.v, collapse.position);
+			// the shared triangles were counted for both vertices
+			removed_count += (triangle_count - state.vertex_triangles[collapse.u].size()) / 2;
+
+			push_edges(collapse.u);
+		}
+
+		return removed_count;
+	}
+
+	// cheapest position & cost to merge v into u
+	bool __find_collapse(const DecimationState& state, const int u, const int v, EdgeCollapse& out_collapse)
+	{
+		Quadric quadric = state.quadrics[u];
+		quadric.add(state.quadrics[v]);
+
+		Point3d candidates[4] = {
+			state.positions[u],
+			state.positions[v],
+			(state.positions[u] + state.positions[v]) * .5
+		};
+		int candidate_count = quadric.optimize(candidates[3]) ? 4 : 3;
+
+		out_collapse.cost = DBL_MAX;
+		for (auto i = 0; i < candidate_count; i++)
+		{
+			const auto& candidate = candidates[i];
+			double cost = quadric.evaluate(candidate);
+			if (cost < out_collapse.cost)
+			{
+				out_collapse.cost = cost;
+				out_collapse.position = candidate;
+			}
+		}
+
+		out_collapse.u = u;
+		out_collapse.v = v;
+		out_collapse.u_version = state.versions[u];
+		out_collapse.v_version = state.versions[v];
+		return out_collapse.cost < DBL_MAX;
+	}
+
+	// keep the mesh manifold & do not fold triangles over
+	bool __can_collapse(const DecimationState& state, const int u, const int v, const Point3d& position)
+	{
+		// the only common neighbours allowed are the opposite vertices of the shared triangles
+		vector<int> u_neighbours, v_neighbours;
+		size_t shared_count = 0;
+
+		for (auto t : state.vertex_triangles[u])
+		{
+			auto& triangle = state.triangles[t];
+			bool shared = triangle[0] == v || triangle[1] == v || triangle[2] == v;
+			if (shared) shared_count++;
+
+			for (auto i = 0; i < 3; i++)
+			{
+				if (triangle[i] != u && triangle[i] != v) u_neighbours.push_back(triangle[i]);
+			}
+		}
+
+		for (auto t : state.vertex_triangles[v])
+		{
+			auto& triangle = state.triangles[t];
+			for (auto i = 0; i < 3; i++)
+			{
+				if (triangle[i] != u && triangle[i] != v) v_neighbours.push_back(triangle[i]);
+			}
+		}
+
+		if (shared_count == 0) return false;
+
+		sort(u_neighbours.begin(), u_neighbours.end());
+		u_neighbours.erase(unique(u_neighbours.begin(), u_neighbours.end()), u_neighbours.end());
+		sort(v_neighbours.begin(), v_neighbours.end());
+		v_neighbours.erase(unique(v_neighbours.begin(), v_neighbours.end()), v_neighbours.end());
+
+		vector<int> common;
+		set_intersection(u_neighbours.begin(), u_neighbours.end(), v_neighbours.begin(), v_neighbours.end(), back_inserter(common));
+		if (common.size() != shared_count) return false;
+
+		// the remaining triangles must keep their orientation
+		for (auto vertex : { u, v })
+		{
+			for (auto t : state.vertex_triangles[vertex])
+			{
+				auto& triangle = state.triangles[t];
+				if ((triangle[0] == u || triangle[1] == u || triangle[2] == u) && (triangle[0] == v || triangle[1] == v || triangle[2] == v)) continue;
+
+				Point3d before[3], after[3];
+				for (auto i = 0; i < 3; i++)
+				{
+					before[i] = state.positions[triangle[i]];
+					after[i] = triangle[i] == vertex ? position : before[i];
+				}
+
+				Point3d normal_before = __triangle_normal(before[0], before[1], before[2]);
+				Point3d normal_after = __triangle_normal(after[0], after[1], after[2]);
+				double length_before = sqrt(normal_before.dot(normal_before));
+				double length_after = sqrt(normal_after.dot(normal_after));
+
+				if (length_after <= 1e-12) return false;
+				if (length_before > 0 && normal_before.dot(normal_after) < .2 * length_before * length_after) return false;
+			}
+		}
+
+		return true;
+	}
+
+	// merge v into u at the given position
+	void __collapse_edge(DecimationState& state, const int u, const int v, const Point3d& position)
+	{
+		auto remove_from = [&](int vertex, int t)
+		{
+			auto& list = state.vertex_triangles[vertex];
+			list.erase(remove(list.begin(), list.end(), t), list.end());
+		};
+
+		for (auto t : state.vertex_triangles[v])
+		{
+			auto& triangle = state.triangles[t];
+			if (triangle[0] == u || triangle[1] == u || triangle[2] == u)
+			{
+				// the triangle degenerates into the edge
+				state.removed_triangles[t] = true;
+				for (auto i = 0; i < 3; i++)
+				{
+					if (triangle[i] != v) remove_from(triangle[i], t);
+				}
+			}
+			else
+			{
+				for (auto i = 0; i < 3; i++)
+				{
+					if (triangle[i] == v) triangle[i] = u;
+				}
+				state.vertex_triangles[u].push_back(t);
+			}
+		}
+
+		state.vertex_triangles[v].clear();
+		state.removed_vertices[v] = true;
+		state.quadrics[u].add(state.quadrics[v]);
+		state.positions[u] = position;
+		state.versions[u]++;
+		state.versions[v]++;
+	}
+
+	// unnormalized normal of the triangle
+	Point3d __triangle_normal(const Point3d& p0, const Point3d& p1, const Point3d& p2)
+	{
+		return (p1 - p0).cross(p2 - p0);
+	}
+
+#pragma endregion
+}
+
+#endif // !MESH_H
@@ -4,8 +4,19 @@
 
 #include <opencv2/opencv.hpp>
 #include <cmath>
+#include <climits>
+#include <cstdint>
+#include <cstring>
+#include <fstream>
 #include <algorithm>
+#include <array>
+#include <atomic>
+#include <bitset>
+#include <memory>
 #include <regex>
+#include <thread>
+#include <unordered_map>
+#include "trace.h"
 
 using namespace std;
 using namespace cv;
@@ -15,6 +26,7 @@ namespace rc
 #pragma region type_declaration
 
 	typedef map<int, String> ImageSrcSet;
+	typedef map<int, Mat> ImageSet;
 
 	typedef vector<Point> Contour;
 	typedef vector<Contour> Contours;
@@ -22,23 +34,50 @@ namespace rc
 
 	typedef Mat Shape;
 	typedef map<int, Shape> ShapeSet;
+	// summed area table of a shape, the filled pixels of any rectangle are 4 lookups
+	typedef struct ShapeSumTable
+	{
+		Size size;
+		vector<int> sums; // (height + 1) x (width + 1), the first row & column are 0
+	};
+
 	typedef struct OthProjection
 	{
 		Shape front;
 		Shape left;
 		Shape top;
+		int scale = 1; // the shapes are 1 / scale of the full image resolution
+		Size image_size; // full image resolution, a reduced decode rounds the shape size up
+		ShapeSumTable front_sums, left_sums, top_sums; // for refine_volume, see create_projection_sum_tables
+	};
+
+	// integer cell of the carving lattice
+	typedef struct LatticePoint
+	{
+		uint16_t x, y, z;
 	};
 
-	typedef vector<Point3d> PointCloud;
+	typedef uint64_t MortonKey;
+
+	typedef vector<LatticePoint> PointCloud;
+	typedef vector<Point3f> WorldPointCloud;
+
+	// world position of a lattice point is origin + point * cube_size, cell indices start at 1
+	// so the neighbours at - 1 are still inside the volume
+	typedef struct Lattice
+	{
+		Point3i origin;
+		int cube_size;
+	};
 
 	typedef struct PointCloudBoundary
 	{
 		int minX, minY, minZ, maxX, maxY, maxZ;
 	};
 
-	typedef enum PointCloudOriginForm { _2D, _3D };
-
-	typedef vector<vector<vector<bool>>> Volume;
+	// volumes are stored in bricks of 8 x 8 x 8 cells, the cells of a brick in morton order
+	const int brick_size = 8;
+	typedef bitset<brick_size * brick_size * brick_size> Brick;
 
 	typedef struct Cube
 	{
@@ -53,22 +92,396 @@ namespace rc
 
 	typedef vector<Normal> NormalSet;
 
+	// which connected components (cells sharing a face) survive remove_islands
+	typedef struct IslandFilter
+	{
+		size_t min_cell_count = 0;
+		bool keep_largest = false;
+	};
+
+	// the components inside one brick, local component l is node node_offset + l of the union-find
+	typedef struct IslandBrick
+	{
+		Point3i position;
+		const Brick* cells; // null for a solid brick
+		vector<uint16_t> labels; // local component per cell, empty for a solid brick
+		vector<uint32_t> cell_counts; // cells per local component
+		uint32_t node_offset;
+	};
+
+	const uint16_t island_empty_label = UINT16_MAX;
+
+	// how the samples of a brick project into one view
+	enum FootprintClass
+	{
+		footprint_outside = -1, footprint_mixed = 0, footprint_inside = 1
+	};
+
+	// silhouette areas & perimeters (full resolution pixels) of the front, left & top views,
+	// and the extent of the carving domain
+	typedef struct ProjectionMeasure
+	{
+		double area[3];
+		double perimeter[3];
+		Point3d extent;
+	};
+
+	// limits of a budget mode job, 0 means no limit
+	typedef struct CarvingBudget
+	{
+		double seconds = 0;
+		double memory_size = 0;
+		double triangle_count = 0;
+	};
+
+	// cost of a reconstruction from the carving to the levels of detail
+	typedef struct CarvingEstimate
+	{
+		int cube_size = 0;
+		double cell_count = 0;
+		double face_count = 0;
+		double memory_size = 0;
+		double seconds = 0;
+	};
+
+	// cost model of the budget mode, fitted on a single thread of an x86-64 desktop cpu (release build)
+	// to the run times of 800x600 synthetic silhouettes carved at cube size 3 to 30,
+	// refit it on much slower or faster machines:
+	//   carve    per cell of the carving domain, the silhouette lookups of carve_volume
+	//   extract  per filled cell, find_surface_vertices & the world mapping
+	//   mesh     per surface face, welding & the levels of detail, the squared term covers the decimation passes
+	const double carve_seconds_per_domain_cell = 25e-9;
+	const double extract_seconds_per_cell = 2.5e-6;
+	const double mesh_seconds_per_face = 14e-6;
+	const double mesh_seconds_per_face_squared = 1.7e-9;
+	const double volume_bricks_per_face = .02;
+	const double model_bytes_per_face = 170; // surface quads, world copy, full mesh & levels of detail
+
 #pragma endregion
 
 #pragma region methods_declaration
 
 	void extract_image_src_set(const String& dir, ImageSrcSet& out_image_src_set);
+	int select_decode_scale(const int cube_size, const double accuracy = .25);
+	Size read_image_size(const ImageSrcSet& image_src_set);
+	Size read_image_size(const String& path);
+	void decode_image_set(const ImageSrcSet& image_src_set, ImageSet& out_image_set, const int scale = 1);
 	void extract_shape(const ImageSrcSet& image_src_set, ShapeSet& out_shape_set);
-	void create_othogonal_projection(const ShapeSet& shape_set, OthProjection& out_othogonal_Projection);
-	void calculate_point_cloud(const OthProjection& othogonal_projection, PointCloud& out_point_cloud, const int cube_size = 10);
-	void find_surface_vertices(PointCloud& point_cloud, PointCloud& out_point_cloud, NormalSet& out_normal_set, const int cube_size, const Size image_size);
-	void convert_point_cloud_to_volume(const PointCloud& point_cloud, Volume& out_volume, const Size image_size);
-	void __extract_contours(const ImageSrcSet& image_src_set, ContoursSet& out_contours_set);
+	void extract_shape(const ImageSet& image_set, ShapeSet& out_shape_set);
+	void create_othogonal_projection(const ShapeSet& shape_set, OthProjection& out_othogonal_Projection, const int scale = 1, const Size image_size = Size());
+	Size get_projection_size(const OthProjection& othogonal_projection);
+	void create_projection_sum_tables(OthProjection& othogonal_projection);
+	bool calculate_carving_boundary(const OthProjection& othogonal_projection, PointCloudBoundary& out_boundary, const int cube_size);
+	void measure_projection(const OthProjection& othogonal_projection, ProjectionMeasure& out_measure);
+	void estimate_carving_cost(const ProjectionMeasure& measure, const int cube_size, CarvingEstimate& out_estimate);
+	int select_cube_size(const ProjectionMeasure& measure, const CarvingBudget& budget, CarvingEstimate& out_estimate, const int min_cube_size = 2, const int max_cube_size = 64);
+	template <typename TVolume> void carve_volume(const OthProjection& othogonal_projection, TVolume& out_volume, Lattice& out_lattice, const int cube_size = 10);
+	template <typename TVolume> void refine_volume(const OthProjection& othogonal_projection, const TVolume& coarse_volume, const Lattice& coarse_lattice, TVolume& out_volume, Lattice& out_lattice);
+	template <typename TVolume> size_t remove_islands(TVolume& volume, const IslandFilter& filter, const int partition_count = thread::hardware_concurrency());
+	template <typename TVolume> void find_surface_vertices(const TVolume& volume, PointCloud& out_point_cloud, NormalSet& out_normal_set);
+	Point3f get_world_point(const LatticePoint& point, const Lattice& lattice);
+	MortonKey encode_morton_key(const LatticePoint& point);
+	MortonKey encode_morton_key(const int x, const int y, const int z);
+	LatticePoint decode_morton_key(const MortonKey key);
+	void __extract_contours(const ImageSet& image_set, ContoursSet& out_contours_set);
+	bool __is_shape_pixel(const Shape& shape, const int x, const int y, const int scale);
 	bool __surface_condition_check(const Cube cube, const vector<bool> face_points);
-	void __convert_point_cloud_origin_form(PointCloud& point_cloud, const PointCloudOriginForm origin_form, const Size image_size);
-	void __rotate_point_cloud_x_axis(PointCloud& point_cloud, float degree);
-	void __rotate_point_cloud_y_axis(PointCloud& point_cloud, float degree);
-	void __transform_point_cloud(PointCloud& point_cloud, Point3d distance);
+	bool __is_carved_pixel(const OthProjection& othogonal_projection, const Size image_size, const int x, const int y, const int z);
+	void __create_shape_sum_table(const Shape& shape, ShapeSumTable& out_table);
+	FootprintClass __classify_footprint(const ShapeSumTable& table, const int scale, const int u_first, const int u_last, const int v_first, const int v_last);
+	void __measure_shape(const Shape& shape, const int scale, double& out_area, double& out_perimeter);
+	bool __fits_budget(const CarvingEstimate& estimate, const CarvingBudget& budget);
+	LatticePoint __lattice_point(const int x, const int y, const int z);
+	MortonKey __spread_morton_bits(MortonKey value);
+	MortonKey __compact_morton_bits(MortonKey value);
+	int __brick_cell_index(const int x, const int y, const int z);
+	template <typename Callback> void __for_each_brick_cell(const vector<pair<MortonKey, const Brick*>>& sorted_bricks, Callback callback);
+	template <typename Callback> void __parallel_for(const size_t count, const int partition_count, Callback callback);
+	void __label_brick_cells(const Brick& cells, vector<uint16_t>& out_labels, vector<uint32_t>& out_cell_counts);
+	uint32_t __find_island_root(vector<atomic<uint32_t>>& parents, uint32_t node);
+	void __unite_islands(vector<atomic<uint32_t>>& parents, uint32_t a, uint32_t b);
+
+#pragma endregion
+
+#pragma region volume_definition
+
+	// every brick is allocated, bricks are found by index arithmetic
+	struct DenseVolume
+	{
+		Point3i size = Point3i(0, 0, 0);
+		Point3i brick_count = Point3i(0, 0, 0);
+		vector<Brick> bricks;
+
+		void reset(const Point3i volume_size)
+		{
+			size = volume_size;
+			brick_count = Point3i(
+				(size.x + brick_size - 1) / brick_size,
+				(size.y + brick_size - 1) / brick_size,
+				(size.z + brick_size - 1) / brick_size
+			);
+			bricks.assign((size_t)brick_count.x * brick_count.y * brick_count.z, Brick());
+		}
+
+		// the cells of the brick, null outside of the volume
+		const Brick* find_brick(const int brick_x, const int brick_y, const int brick_z, bool& out_solid) const
+		{
+			out_solid = false;
+			return __contains_brick(brick_x, brick_y, brick_z) ? &bricks[__brick_idx(brick_x, brick_y, brick_z)] : nullptr;
+		}
+
+		bool at(const int x, const int y, const int z) const
+		{
+			if (x < 0 || y < 0 || z < 0) return false;
+
+			bool solid;
+			auto brick = find_brick(x / brick_size, y / brick_size, z / brick_size, solid);
+			return brick != nullptr && brick->test(__brick_cell_index(x, y, z));
+		}
+
+		void set(const int x, const int y, const int z, const bool filled = true)
+		{
+			if (x < 0 || y < 0 || z < 0 || !__contains_brick(x / brick_size, y / brick_size, z / brick_size)) return;
+			bricks[__brick_idx(x / brick_size, y / brick_size, z / brick_size)].set(__brick_cell_index(x, y, z), filled);
+		}
+
+		void set_brick(const int brick_x, const int brick_y, const int brick_z, const Brick& cells)
+		{
+			if (__contains_brick(brick_x, brick_y, brick_z)) bricks[__brick_idx(brick_x, brick_y, brick_z)] = cells;
+		}
+
+		// visit the filled cells in morton order
+		template <typename Callback>
+		void for_each_cell(Callback callback) const
+		{
+			vector<pair<MortonKey, const Brick*>> sorted_bricks;
+			for (auto z = 0; z < brick_count.z; z++)
+			{
+				for (auto y = 0; y < brick_count.y; y++)
+				{
+					for (auto x = 0; x < brick_count.x; x++)
+					{
+						bool solid;
+						auto brick = find_brick(x, y, z, solid);
+						if (brick->any()) sorted_bricks.push_back(make_pair(encode_morton_key(x, y, z), brick));
+					}
+				}
+			}
+
+			__for_each_brick_cell(sorted_bricks, callback);
+		}
+
+		// visit the bricks holding filled cells
+		template <typename Callback>
+		void for_each_brick(Callback callback) const
+		{
+			for (auto z = 0; z < brick_count.z; z++)
+			{
+				for (auto y = 0; y < brick_count.y; y++)
+				{
+					for (auto x = 0; x < brick_count.x; x++)
+					{
+						const auto& brick = bricks[__brick_idx(x, y, z)];
+						if (brick.any()) callback(x, y, z, &brick);
+					}
+				}
+			}
+		}
+
+		size_t count() const
+		{
+			size_t filled_count = 0;
+			for (const auto& brick : bricks) filled_count += brick.count();
+			return filled_count;
+		}
+
+		size_t memory_size() const
+		{
+			return bricks.size() * sizeof(Brick);
+		}
+
+		bool __contains_brick(const int brick_x, const int brick_y, const int brick_z) const
+		{
+			return brick_x >= 0 && brick_y >= 0 && brick_z >= 0 && brick_x < brick_count.x && brick_y < brick_count.y && brick_z < brick_count.z;
+		}
+
+		size_t __brick_idx(const int brick_x, const int brick_y, const int brick_z) const
+		{
+			return ((size_t)brick_z * brick_count.y + brick_y) * brick_count.x + brick_x;
+		}
+	};
+
+	// only bricks on the boundary store their cells, empty bricks are absent
+	// and bricks that are completely filled are kept without cells
+	struct SparseVolume
+	{
+		Point3i size = Point3i(0, 0, 0);
+		unordered_map<MortonKey, unique_ptr<Brick>> bricks;
+
+		void reset(const Point3i volume_size)
+		{
+			size = volume_size;
+			bricks.clear();
+		}
+
+		// the cells of the brick, null for an empty brick or a solid one
+		const Brick* find_brick(const int brick_x, const int brick_y, const int brick_z, bool& out_solid) const
+		{
+			out_solid = false;
+			if (brick_x < 0 || brick_y < 0 || brick_z < 0) return nullptr;
+
+			auto found = bricks.find(encode_morton_key(brick_x, brick_y, brick_z));
+			if (found == bricks.end()) return nullptr;
+
+			out_solid = found->second == nullptr;
+			return found->second.get();
+		}
+
+		bool at(const int x, const int y, const int z) const
+		{
+			if (x < 0 || y < 0 || z < 0) return false;
+
+			bool solid;
+			auto brick = find_brick(x / brick_size, y / brick_size, z / brick_size, solid);
+			return solid || (brick != nullptr && brick->test(__brick_cell_index(x, y, z)));
+		}
+
+		void set(const int x, const int y, const int z, const bool filled = true)
+		{
+			if (x < 0 || y < 0 || z < 0) return;
+
+			auto key = encode_morton_key(x / brick_size, y / brick_size, z / brick_size);
+			auto found = bricks.find(key);
+
+			if (found == bricks.end())
+			{
+				if (!filled) return;
+				found = bricks.emplace(key, make_unique<Brick>()).first;
+			}
+			else if (found->second == nullptr)
+			{
+				if (filled) return;
+				found->second = make_unique<Brick>(Brick().set());
+			}
+
+			found->second->set(__brick_cell_index(x, y, z), filled);
+		}
+
+		void set_brick(const int brick_x, const int brick_y, const int brick_z, const Brick& cells)
+		{
+			if (brick_x < 0 || brick_y < 0 || brick_z < 0) return;
+
+			auto key = encode_morton_key(brick_x, brick_y, brick_z);
+			if (cells.none()) bricks.erase(key);
+			else if (cells.all()) bricks[key] = nullptr;
+			else bricks[key] = make_unique<Brick>(cells);
+		}
+
+		// visit the filled cells in morton order
+		template <typename Callback>
+		void for_each_cell(Callback callback) const
+		{
+			static const Brick solid_brick = Brick().set();
+
+			vector<pair<MortonKey, const Brick*>> sorted_bricks;
+			sorted_bricks.reserve(bricks.size());
+			for (const auto& brick : bricks)
+			{
+				sorted_bricks.push_back(make_pair(brick.first, brick.second == nullptr ? &solid_brick : brick.second.get()));
+			}
+			sort(sorted_bricks.begin(), sorted_bricks.end());
+
+			__for_each_brick_cell(sorted_bricks, callback);
+		}
+
+		// visit the stored bricks, the cells are null for a solid brick
+		template <typename Callback>
+		void for_each_brick(Callback callback) const
+		{
+			for (const auto& brick : bricks)
+			{
+				auto position = decode_morton_key(brick.first);
+				callback((int)position.x, (int)position.y, (int)position.z, (const Brick*)brick.second.get());
+			}
+		}
+
+		size_t count() const
+		{
+			size_t filled_count = 0;
+			for (const auto& brick : bricks) filled_count += brick.second == nullptr ? Brick().size() : brick.second->count();
+			return filled_count;
+		}
+
+		size_t memory_size() const
+		{
+			// rough node cost of the hash map plus the stored cells
+			size_t memory = bricks.bucket_count() * sizeof(void*) + bricks.size() * (sizeof(MortonKey) + sizeof(unique_ptr<Brick>) + 2 * sizeof(void*));
+			for (const auto& brick : bricks)
+			{
+				if (brick.second != nullptr) memory += sizeof(Brick);
+			}
+			return memory;
+		}
+	};
+
+	// cached read access for the neighbour lookups, not shared between threads
+	template <typename TVolume>
+	struct VolumeReader
+	{
+		const TVolume& volume;
+		Point3i brick_position = Point3i(INT_MIN, INT_MIN, INT_MIN);
+		const Brick* brick = nullptr;
+		bool solid = false;
+
+		explicit VolumeReader(const TVolume& volume) : volume(volume) {}
+
+		bool at(const int x, const int y, const int z)
+		{
+			if (x < 0 || y < 0 || z < 0) return false;
+
+			Point3i position(x / brick_size, y / brick_size, z / brick_size);
+			if (position.x != brick_position.x || position.y != brick_position.y || position.z != brick_position.z)
+			{
+				brick_position = position;
+				brick = volume.find_brick(position.x, position.y, position.z, solid);
+			}
+			return solid || (brick != nullptr && brick->test(__brick_cell_index(x, y, z)));
+		}
+	};
+
+	// split [0, count) into contiguous ranges, one thread per range
+	template <typename Callback>
+	void __parallel_for(const size_t count, const int partition_count, Callback callback)
+	{
+		size_t thread_count = min<size_t>(max(partition_count, 1), max<size_t>(count, 1));
+		vector<thread> threads;
+
+		for (size_t partition = 0; partition < thread_count; partition++)
+		{
+			threads.emplace_back([&, partition]()
+			{
+				for (auto idx = count * partition / thread_count; idx < count * (partition + 1) / thread_count; idx++) callback(idx);
+			});
+		}
+
+		for (auto& t : threads) t.join();
+	}
+
+	// visit the filled cells of morton-sorted bricks
+	template <typename Callback>
+	void __for_each_brick_cell(const vector<pair<MortonKey, const Brick*>>& sorted_bricks, Callback callback)
+	{
+		for (const auto& brick : sorted_bricks)
+		{
+			for (auto cell_idx = 0; cell_idx < (int)brick.second->size(); cell_idx++)
+			{
+				if (!brick.second->test(cell_idx)) continue;
+
+				auto cell = decode_morton_key((brick.first << 9) | (MortonKey)cell_idx);
+				callback((int)cell.x, (int)cell.y, (int)cell.z);
+			}
+		}
+	}
 
 #pragma endregion
 
@@ -98,17 +511,117 @@ namespace rc
 		}
 	}
 
+	// pick the coarsest decode scale whose sampling error stays within the accuracy (in cubes),
+	// the carving only samples the silhouettes every cube_size pixels anyway. the default quarter cube
+	// keeps the edges canny finds close to the full resolution ones, e.g. 1/2 at cube size 10, 1/8 from 32
+	int select_decode_scale(const int cube_size, const double accuracy)
+	{
+		for (auto scale : { 8, 4, 2 })
+		{
+			if (scale <= cube_size * accuracy) return scale;
+		}
+		return 1;
+	}
+
+	// full resolution of the views, read from the header of the front image, empty when unknown
+	Size read_image_size(const ImageSrcSet& image_src_set)
+	{
+		auto front = image_src_set.find(0);
+		return front == image_src_set.end() ? Size() : read_image_size(front->second);
+	}
+
+	// width & height from the png ihdr chunk or the jpeg start of frame, without decoding
+	Size read_image_size(const String& path)
+	{
+		ifstream ifs(path, ios::binary);
+		uint8_t signature[8];
+		if (!ifs.read((char*)signature, sizeof(signature))) return Size();
+
+		auto read_be = [&](const int byte_count)
+		{
+			uint32_t value = 0;
+			for (auto i = 0; i < byte_count; i++) value = (value << 8) | (uint8_t)ifs.get();
+			return value;
+		};
+
+		const uint8_t png_signature[8] = { 0x89, 'P', 'N', 'G', '\r', '\n', 0x1A, '\n' };
+		if (memcmp(signature, png_signature, sizeof(png_signature)) == 0)
+		{
+			read_be(4);
+			if (read_be(4) != 0x49484452) return Size(); // IHDR
+			auto width = (int)read_be(4);
+			auto height = (int)read_be(4);
+			return ifs ? Size(width, height) : Size();
+		}
+
+		if (signature[0] != 0xFF || signature[1] != 0xD8) return Size();
+
+		// walk the segments after the start of image marker
+		ifs.seekg(2);
+		while (ifs)
+		{
+			if (ifs.get() != 0xFF) return Size();
+
+			int marker;
+			do { marker = ifs.get(); } while (marker == 0xFF);
+			if (marker == EOF || marker == 0xD9 || marker == 0xDA) return Size();
+
+			auto length = read_be(2);
+			if (length < 2) return Size();
+
+			// start of frame, except the dht, jpg & dac markers in the same range
+			if (marker >= 0xC0 && marker <= 0xCF && marker != 0xC4 && marker != 0xC8 && marker != 0xCC)
+			{
+				read_be(1); // precision
+				auto height = (int)read_be(2);
+				auto width = (int)read_be(2);
+				return ifs ? Size(width, height) : Size();
+			}
+
+			ifs.seekg(length - 2, ios::cur);
+		}
+		return Size();
+	}
+
+	// decode the images of the set, separated from the shape extraction so it can run as its own stage
+	void decode_image_set(const ImageSrcSet& image_src_set, ImageSet& out_image_set, const int scale)
+	{
+		// let the codec skip the detail we do not need instead of resizing afterwards
+		int flag = scale >= 8 ? IMREAD_REDUCED_GRAYSCALE_8
+			: scale >= 4 ? IMREAD_REDUCED_GRAYSCALE_4
+			: scale >= 2 ? IMREAD_REDUCED_GRAYSCALE_2
+			: IMREAD_GRAYSCALE;
+
+		for (auto const &img : image_src_set)
+		{
+			RC_TRACE_SCOPE("decode_view");
+			out_image_set[img.first] = imread(img.second, flag);
+		}
+	}
+
 	// extract object shape
 	void extract_shape(const ImageSrcSet& image_src_set, ShapeSet& out_shape_set)
 	{
+		ImageSet image_set;
+		decode_image_set(image_src_set, image_set);
+		extract_shape(image_set, out_shape_set);
+	}
+
+	// extract object shape from decoded images
+	void extract_shape(const ImageSet& image_set, ShapeSet& out_shape_set)
+	{
+		RC_TRACE_SCOPE("extract_shape");
+
 		// extract contours
 		ContoursSet contours_set;
-		__extract_contours(image_src_set, contours_set);
+		__extract_contours(image_set, contours_set);
 
 		for (auto const &contours : contours_set)
 		{
+			RC_TRACE_SCOPE("fill_shape");
+
 			// detect shape outline
-			auto size = imread(image_src_set.at(contours.first)).size();
+			auto size = image_set.at(contours.first).size();
 			Mat shape_outline = Mat::zeros(size, CV_8UC3);
 
 			for (auto i = 0; i < contours.second.size(); i++)
@@ -128,8 +641,12 @@ namespace rc
 	}
 
 	// create othogonal projection
-	void create_othogonal_projection(const ShapeSet& shape_set, OthProjection& out_othogonal_Projection)
+	void create_othogonal_projection(const ShapeSet& shape_set, OthProjection& out_othogonal_Projection, const int scale, const Size image_size)
 	{
+		RC_TRACE_SCOPE("create_othogonal_projection");
+		out_othogonal_Projection.scale = scale;
+		out_othogonal_Projection.image_size = image_size;
+
 		// front
 		Mat flip_180;
 		flip(shape_set.at(180), flip_180, 1);
@@ -144,332 +661,756 @@ namespace rc
 		out_othogonal_Projection.top = shape_set.at(-1);
 	}
 
-	// calculate point cloud
-	void calculate_point_cloud(const OthProjection& othogonal_projection, PointCloud& out_point_cloud, const int cube_size)
+	// full resolution size of the projection, all the point cloud coordinates are in this space,
+	// estimated from the reduced shapes when the image header could not be read
+	Size get_projection_size(const OthProjection& othogonal_projection)
 	{
-		auto image_size = othogonal_projection.front.size();
-		PointCloud init_point_cloud;
+		if (othogonal_projection.image_size.area() > 0) return othogonal_projection.image_size;
+		return othogonal_projection.front.size() * othogonal_projection.scale;
+	}
 
-		// initial point cloud
-		for (auto z = 0; z < image_size.height; z += cube_size)
+	// summed area tables of the three shapes, only refine_volume reads them
+	void create_projection_sum_tables(OthProjection& othogonal_projection)
+	{
+		RC_TRACE_SCOPE("create_projection_sum_tables");
+
+		__create_shape_sum_table(othogonal_projection.front, othogonal_projection.front_sums);
+		__create_shape_sum_table(othogonal_projection.left, othogonal_projection.left_sums);
+		__create_shape_sum_table(othogonal_projection.top, othogonal_projection.top_sums);
+	}
+
+	// find the tightest carving domain from the front, left & top silhouettes,
+	// false when a silhouette is blank or the views do not overlap
+	bool calculate_carving_boundary(const OthProjection& othogonal_projection, PointCloudBoundary& out_boundary, const int cube_size)
+	{
+		RC_TRACE_SCOPE("calculate_carving_boundary");
+
+		auto image_size = get_projection_size(othogonal_projection);
+		auto scale = othogonal_projection.scale;
+
+		// the left view is sampled at the column of the rotated z coordinate
+		int left_offset = image_size.width / 2 - image_size.height / 2;
+
+		// only the carving lattice is sampled, so the extents are taken on the lattice as well
+		PointCloudBoundary front{ INT_MAX, INT_MAX, 0, INT_MIN, INT_MIN, 0 };
+		PointCloudBoundary top{ INT_MAX, 0, INT_MAX, INT_MIN, 0, INT_MIN };
+		PointCloudBoundary left{ 0, INT_MAX, INT_MAX, 0, INT_MIN, INT_MIN };
+
+		for (auto y = 0; y < image_size.height; y += cube_size)
 		{
-			for (auto y = 0; y < image_size.height; y += cube_size)
+			for (auto x = 0; x < image_size.width; x += cube_size)
 			{
-				for (auto x = 0; x < image_size.width; x += cube_size)
+				if (__is_shape_pixel(othogonal_projection.front, x, y, scale))
 				{
-					// check if the pixel is part of the object
-					auto front_pixel = othogonal_projection.front.at<Vec3b>(y, x);
-					auto top_pixel = othogonal_projection.top.at<Vec3b>(z, x);
+					front.minX = min(front.minX, x);
+					front.maxX = max(front.maxX, x);
+					front.minY = min(front.minY, y);
+					front.maxY = max(front.maxY, y);
+				}
+			}
 
-					if (front_pixel != Vec3b(0, 0, 0) && top_pixel != Vec3b(0, 0, 0))
-					{
-						init_point_cloud.push_back(Point3d(x, y, z));
-					}
+			for (auto z = 0; z < image_size.height; z += cube_size)
+			{
+				auto left_x = z + left_offset;
+				if (left_x < 0 || left_x >= image_size.width) continue;
+
+				if (__is_shape_pixel(othogonal_projection.left, left_x, y, scale))
+				{
+					left.minY = min(left.minY, y);
+					left.maxY = max(left.maxY, y);
+					left.minZ = min(left.minZ, z);
+					left.maxZ = max(left.maxZ, z);
 				}
 			}
 		}
 
-		// rotate to left side (y-axis)
-		__convert_point_cloud_origin_form(init_point_cloud, PointCloudOriginForm::_3D, image_size);
-		__rotate_point_cloud_y_axis(init_point_cloud, -90);
-		__convert_point_cloud_origin_form(init_point_cloud, PointCloudOriginForm::_2D, image_size);
-
-		// finalize point cloud
-		for (const auto point : init_point_cloud)
+		for (auto z = 0; z < image_size.height; z += cube_size)
 		{
-			auto left_pixel = othogonal_projection.left.at<Vec3b>(point.y, point.x);
-			if (left_pixel != Vec3b(0, 0, 0))
+			for (auto x = 0; x < image_size.width; x += cube_size)
 			{
-				out_point_cloud.push_back(point);
+				if (__is_shape_pixel(othogonal_projection.top, x, z, scale))
+				{
+					top.minX = min(top.minX, x);
+					top.maxX = max(top.maxX, x);
+					top.minZ = min(top.minZ, z);
+					top.maxZ = max(top.maxZ, z);
+				}
 			}
 		}
 
-		// rotate back
-		__convert_point_cloud_origin_form(out_point_cloud, PointCloudOriginForm::_3D, image_size);
-		__rotate_point_cloud_x_axis(out_point_cloud, 180);
-		__rotate_point_cloud_y_axis(out_point_cloud, 90);
+		// every axis is seen by two of the views, so the domain is the intersection of both extents
+		out_boundary.minX = max(front.minX, top.minX);
+		out_boundary.maxX = min(front.maxX, top.maxX);
+		out_boundary.minY = max(front.minY, left.minY);
+		out_boundary.maxY = min(front.maxY, left.maxY);
+		out_boundary.minZ = max(top.minZ, left.minZ);
+		out_boundary.maxZ = min(top.maxZ, left.maxZ);
+
+		return out_boundary.minX <= out_boundary.maxX && out_boundary.minY <= out_boundary.maxY && out_boundary.minZ <= out_boundary.maxZ;
 	}
 
-	// remove inner point cloud & optimize for surface rendering
-	void find_surface_vertices(PointCloud& point_cloud, PointCloud& out_point_cloud, NormalSet& out_normal_set, const int cube_size, const Size image_size)
+	// measure the silhouettes once, every cube size is estimated from the same measure
+	void measure_projection(const OthProjection& othogonal_projection, ProjectionMeasure& out_measure)
 	{
-		__convert_point_cloud_origin_form(point_cloud, PointCloudOriginForm::_2D, image_size);
+		RC_TRACE_SCOPE("measure_projection");
 
-		// find the model volume size
-		bool initialize = false;
+		auto scale = othogonal_projection.scale;
+		__measure_shape(othogonal_projection.front, scale, out_measure.area[0], out_measure.perimeter[0]);
+		__measure_shape(othogonal_projection.left, scale, out_measure.area[1], out_measure.perimeter[1]);
+		__measure_shape(othogonal_projection.top, scale, out_measure.area[2], out_measure.perimeter[2]);
 
 		PointCloudBoundary boundary;
-		for (const auto point : point_cloud)
+		out_measure.extent = Point3d(0, 0, 0);
+		if (calculate_carving_boundary(othogonal_projection, boundary, scale))
 		{
-			boundary.minX = !initialize || point.x < boundary.minX ? point.x : boundary.minX;
-			boundary.minY = !initialize || point.y < boundary.minY ? point.y : boundary.minY;
-			boundary.minZ = !initialize || point.z < boundary.minZ ? point.z : boundary.minZ;
+			out_measure.extent = Point3d(boundary.maxX - boundary.minX, boundary.maxY - boundary.minY, boundary.maxZ - boundary.minZ);
+		}
+	}
+
+	// the volume is bounded by the silhouette areas (loomis-whitney, ~.7 of the bound for rounded objects),
+	// the faces of an axis are about twice the silhouette area minus the perimeter cells a quad cannot cover
+	void estimate_carving_cost(const ProjectionMeasure& measure, const int cube_size, CarvingEstimate& out_estimate)
+	{
+		double cube_area = (double)cube_size * cube_size;
+		double cube_volume = cube_area * cube_size;
+
+		double domain_cell_count = (measure.extent.x / cube_size + 1) * (measure.extent.y / cube_size + 1) * (measure.extent.z / cube_size + 1);
+		double area_sum = measure.area[0] + measure.area[1] + measure.area[2];
+		double perimeter_sum = measure.perimeter[0] + measure.perimeter[1] + measure.perimeter[2];
 
-			boundary.maxX = !initialize || point.x > boundary.maxX ? point.x : boundary.maxX;
-			boundary.maxY = !initialize || point.y > boundary.maxY ? point.y : boundary.maxY;
-			boundary.maxZ = !initialize || point.z > boundary.maxZ ? point.z : boundary.maxZ;
-			initialize = true;
+		out_estimate.cube_size = cube_size;
+		out_estimate.cell_count = min(.7 * sqrt(measure.area[0] * measure.area[1] * measure.area[2]) / cube_volume, domain_cell_count);
+		out_estimate.face_count = max(2 * area_sum / cube_area - perimeter_sum / cube_size, 0.0);
+
+		out_estimate.memory_size = out_estimate.face_count * (volume_bricks_per_face * sizeof(Brick) + model_bytes_per_face);
+		out_estimate.seconds = domain_cell_count * carve_seconds_per_domain_cell
+			+ out_estimate.cell_count * extract_seconds_per_cell
+			+ out_estimate.face_count * (mesh_seconds_per_face + out_estimate.face_count * mesh_seconds_per_face_squared);
+	}
+
+	// finest cube size within the budget, the coarsest one when nothing fits
+	int select_cube_size(const ProjectionMeasure& measure, const CarvingBudget& budget, CarvingEstimate& out_estimate, const int min_cube_size, const int max_cube_size)
+	{
+		for (auto cube_size = min_cube_size; cube_size <= max_cube_size; cube_size++)
+		{
+			estimate_carving_cost(measure, cube_size, out_estimate);
+			if (__fits_budget(out_estimate, budget)) return cube_size;
 		}
+		return out_estimate.cube_size;
+	}
+
+	// carve the volume, one brick at a time so the sparse volume never holds cells of empty or solid bricks
+	template <typename TVolume>
+	void carve_volume(const OthProjection& othogonal_projection, TVolume& out_volume, Lattice& out_lattice, const int cube_size)
+	{
+		RC_TRACE_SCOPE("carve_volume");
 
-		// create a model volume
-		Volume volume;
-		convert_point_cloud_to_volume(point_cloud, volume, image_size);
+		auto image_size = get_projection_size(othogonal_projection);
+		auto scale = othogonal_projection.scale;
 
-		for (auto x = boundary.minX; x < boundary.maxX; x += cube_size)
+		// skip everything outside the silhouettes, the loops stay on the same lattice,
+		// nothing is carved when a view sees nothing
+		out_lattice.cube_size = cube_size;
+		PointCloudBoundary boundary;
+		if (!calculate_carving_boundary(othogonal_projection, boundary, cube_size))
+		{
+			out_lattice.origin = Point3i(0, 0, 0);
+			out_volume.reset(Point3i(0, 0, 0));
+			return;
+		}
+
+		// the left view sees the object rotated by 90 degree around the y-axis,
+		// so a point is sampled there at the column of its z coordinate
+		int left_offset = image_size.width / 2 - image_size.height / 2;
+
+		// the model faces the camera, x & y are mirrored from the image space:
+		// world = (w/2 - x, h/2 - y, z - h/2), the same axes the rotations of the former
+		// point cloud pass (y -90, x 180, y 90 degree) ended on, so x stays x & z stays z
+		out_lattice.origin = Point3i(
+			image_size.width / 2 - boundary.maxX - cube_size,
+			image_size.height / 2 - boundary.maxY - cube_size,
+			boundary.minZ - cube_size - image_size.height / 2
+		);
+
+		// cells 1 to n hold the carving domain, with an empty cell around it
+		Point3i cell_count(
+			(boundary.maxX - boundary.minX) / cube_size + 1,
+			(boundary.maxY - boundary.minY) / cube_size + 1,
+			(boundary.maxZ - boundary.minZ) / cube_size + 1
+		);
+		out_volume.reset(cell_count + Point3i(2, 2, 2));
+
+		for (auto brick_z = 0; brick_z * brick_size <= cell_count.z; brick_z++)
 		{
-			for (auto y = boundary.minY; y < boundary.maxY; y += cube_size)
+			RC_TRACE_SCOPE("carve_brick_layer");
+
+			for (auto brick_y = 0; brick_y * brick_size <= cell_count.y; brick_y++)
 			{
-				for (auto z = boundary.minZ; z < boundary.maxZ; z += cube_size)
+				for (auto brick_x = 0; brick_x * brick_size <= cell_count.x; brick_x++)
 				{
-#pragma region front
-					Cube cube
+					Brick brick;
+
+					for (auto k = max(brick_z * brick_size, 1); k < min((brick_z + 1) * brick_size, cell_count.z + 1); k++)
 					{
-						vector<bool>{
-							volume[x][y + cube_size][z],
-							volume[x + cube_size][y + cube_size][z],
-							volume[x + cube_size][y][z],
-							volume[x][y][z]
-						},
-						vector<bool>
+						auto z = boundary.minZ + (k - 1) * cube_size;
+
+						for (auto j = max(brick_y * brick_size, 1); j < min((brick_y + 1) * brick_size, cell_count.y + 1); j++)
 						{
-							volume[x][y + cube_size][z + cube_size],
-							volume[x + cube_size][y + cube_size][z + cube_size],
-							volume[x + cube_size][y][z + cube_size],
-							volume[x][y][z + cube_size]
+							auto y = boundary.maxY - (j - 1) * cube_size;
+
+							for (auto i = max(brick_x * brick_size, 1); i < min((brick_x + 1) * brick_size, cell_count.x + 1); i++)
+							{
+								auto x = boundary.maxX - (i - 1) * cube_size;
+
+								// check if the pixel is part of the object in every view
+								if (__is_shape_pixel(othogonal_projection.front, x, y, scale) &&
+									__is_shape_pixel(othogonal_projection.top, x, z, scale) &&
+									__is_shape_pixel(othogonal_projection.left, z + left_offset, y, scale))
+								{
+									brick.set(__brick_cell_index(i, j, k));
+								}
+							}
 						}
-					};
+					}
 
-					vector<bool> face_points
-					{
-						volume[x][y + cube_size][z - cube_size],
-						volume[x + cube_size][y + cube_size][z - cube_size],
-						volume[x + cube_size][y][z - cube_size],
-						volume[x][y][z - cube_size]
+					if (brick.any()) out_volume.set_brick(brick_x, brick_y, brick_z, brick);
+				}
+			}
+		}
+	}
+
+	// carve at half the cube size of a coarse volume, the coarse samples are every other fine sample
+	// & the fine domain is the coarse one grown by a fine cell. a brick whose samples project fully inside
+	// all three silhouettes is solid, one outside of any silhouette is empty, so only the bricks on
+	// the silhouette boundaries test their samples & the result is the direct carve of that domain
+	template <typename TVolume>
+	void refine_volume(const OthProjection& othogonal_projection, const TVolume& coarse_volume, const Lattice& coarse_lattice, TVolume& out_volume, Lattice& out_lattice)
+	{
+		RC_TRACE_SCOPE("refine_volume");
+
+		auto image_size = get_projection_size(othogonal_projection);
+		auto coarse_size = coarse_lattice.cube_size;
+		auto cube_size = coarse_size / 2;
+
+		// an empty carve stays empty
+		out_lattice.cube_size = cube_size;
+		if (coarse_volume.size.x <= 2 || coarse_volume.size.y <= 2 || coarse_volume.size.z <= 2)
+		{
+			out_lattice.origin = Point3i(0, 0, 0);
+			out_volume.reset(Point3i(0, 0, 0));
+			return;
+		}
+
+		// coarse sample (i, j, k) is at (max_x - (i - 1) * coarse_size, max_y - (j - 1) * coarse_size, min_z + (k - 1) * coarse_size)
+		auto max_x = image_size.width / 2 - coarse_lattice.origin.x - coarse_size;
+		auto max_y = image_size.height / 2 - coarse_lattice.origin.y - coarse_size;
+		auto min_z = coarse_lattice.origin.z + coarse_size + image_size.height / 2;
+
+		// the fine domain reaches one fine cell past the coarse one, fine sample 2 * i is coarse sample i
+		auto coarse_count = coarse_volume.size - Point3i(2, 2, 2);
+		Point3i cell_count(2 * coarse_count.x + 1, 2 * coarse_count.y + 1, 2 * coarse_count.z + 1);
+		max_x += cube_size;
+		max_y += cube_size;
+		min_z -= cube_size;
+
+		out_lattice.origin = Point3i(
+			image_size.width / 2 - max_x - cube_size,
+			image_size.height / 2 - max_y - cube_size,
+			min_z - cube_size - image_size.height / 2
+		);
+		out_volume.reset(cell_count + Point3i(2, 2, 2));
+
+		auto scale = othogonal_projection.scale;
+		int left_offset = image_size.width / 2 - image_size.height / 2;
+
+		// every level refines against the same tables, a projection without them gets its own copy
+		const OthProjection* projection = &othogonal_projection;
+		OthProjection summed_projection;
+		if (othogonal_projection.front_sums.sums.empty())
+		{
+			summed_projection = othogonal_projection;
+			create_projection_sum_tables(summed_projection);
+			projection = &summed_projection;
+		}
+		auto& front_table = projection->front_sums;
+		auto& left_table = projection->left_sums;
+		auto& top_table = projection->top_sums;
+
+		// the sampled coordinates of a view, z is limited by the image height & by the left view column
+		auto clip = [](const int first, const int last, const int low, const int high, int& out_first, int& out_last)
+		{
+			out_first = max(first, low);
+			out_last = min(last, high);
+			return out_first != first || out_last != last;
+		};
+
+		for (auto brick_z = 0; brick_z * brick_size <= cell_count.z; brick_z++)
+		{
+			RC_TRACE_SCOPE("refine_brick_layer");
+
+			for (auto brick_y = 0; brick_y * brick_size <= cell_count.y; brick_y++)
+			{
+				for (auto brick_x = 0; brick_x * brick_size <= cell_count.x; brick_x++)
+				{
+					Point3i first(max(brick_x * brick_size, 1), max(brick_y * brick_size, 1), max(brick_z * brick_size, 1));
+					Point3i last(
+						min((brick_x + 1) * brick_size, cell_count.x + 1) - 1,
+						min((brick_y + 1) * brick_size, cell_count.y + 1) - 1,
+						min((brick_z + 1) * brick_size, cell_count.z + 1) - 1
+					);
+					if (first.x > last.x || first.y > last.y || first.z > last.z) continue;
+
+					// the box of the brick samples, only the part inside the images can be filled
+					Point3i box_first, box_last;
+					auto clipped = clip(max_x - (last.x - 1) * cube_size, max_x - (first.x - 1) * cube_size, 0, image_size.width - 1, box_first.x, box_last.x);
+					clipped |= clip(max_y - (last.y - 1) * cube_size, max_y - (first.y - 1) * cube_size, 0, image_size.height - 1, box_first.y, box_last.y);
+					clipped |= clip(min_z + (first.z - 1) * cube_size, min_z + (last.z - 1) * cube_size,
+						max(0, -left_offset), min(image_size.height, image_size.width - left_offset) - 1, box_first.z, box_last.z);
+					if (box_first.x > box_last.x || box_first.y > box_last.y || box_first.z > box_last.z) continue;
+
+					// a box outside of one view is empty, a box inside of all three is solid,
+					// only the bricks on the silhouette boundaries test their samples
+					FootprintClass footprints[3] = {
+						__classify_footprint(front_table, scale, box_first.x, box_last.x, box_first.y, box_last.y),
+						__classify_footprint(top_table, scale, box_first.x, box_last.x, box_first.z, box_last.z),
+						__classify_footprint(left_table, scale, box_first.z + left_offset, box_last.z + left_offset, box_first.y, box_last.y)
 					};
+					if (footprints[0] == footprint_outside || footprints[1] == footprint_outside || footprints[2] == footprint_outside) continue;
+					auto solid = !clipped && footprints[0] == footprint_inside && footprints[1] == footprint_inside && footprints[2] == footprint_inside;
 
-					if (__surface_condition_check(cube, face_points))
+					Brick brick;
+					for (auto k = first.z; k <= last.z; k++)
 					{
-						out_point_cloud.push_back(Point3d(x, y + cube_size, z));
-						out_point_cloud.push_back(Point3d(x + cube_size, y + cube_size, z));
-						out_point_cloud.push_back(Point3d(x + cube_size, y, z));
-						out_point_cloud.push_back(Point3d(x, y, z));
+						auto z = min_z + (k - 1) * cube_size;
 
-						out_normal_set.push_back(Normal{ 0, 0, -1 });
+						for (auto j = first.y; j <= last.y; j++)
+						{
+							auto y = max_y - (j - 1) * cube_size;
+
+							for (auto i = first.x; i <= last.x; i++)
+							{
+								auto x = max_x - (i - 1) * cube_size;
+								if (solid || __is_carved_pixel(othogonal_projection, image_size, x, y, z)) brick.set(__brick_cell_index(i, j, k));
+							}
+						}
 					}
+
+					if (brick.any()) out_volume.set_brick(brick_x, brick_y, brick_z, brick);
+				}
+			}
+		}
+	}
+
+	// drop the connected components the filter rejects & return the removed cell count.
+	// every brick is labelled on its own in parallel, then the components are joined across the brick faces
+	// in parallel with a lock free union-find, only the bricks that lose cells are written back.
+	// only the stored bricks are visited, the neighbours are found by morton key
+	template <typename TVolume>
+	size_t remove_islands(TVolume& volume, const IslandFilter& filter, const int partition_count)
+	{
+		RC_TRACE_SCOPE("remove_islands");
+
+		if (!filter.keep_largest && filter.min_cell_count <= 1) return 0;
+
+		vector<IslandBrick> bricks;
+		volume.for_each_brick([&](const int brick_x, const int brick_y, const int brick_z, const Brick* cells)
+		{
+			// a dense volume has no solid bricks, full ones are one component all the same
+			bricks.push_back(IslandBrick{ Point3i(brick_x, brick_y, brick_z), cells == nullptr || cells->all() ? nullptr : cells });
+		});
+
+		unordered_map<MortonKey, int> brick_indices;
+		brick_indices.reserve(bricks.size());
+		for (auto brick_idx = 0; brick_idx < (int)bricks.size(); brick_idx++)
+		{
+			auto& position = bricks[brick_idx].position;
+			brick_indices.emplace(encode_morton_key(position.x, position.y, position.z), brick_idx);
+		}
+
+		__parallel_for(bricks.size(), partition_count, [&](const size_t brick_idx)
+		{
+			auto& brick = bricks[brick_idx];
+			if (brick.cells == nullptr) brick.cell_counts.assign(1, (uint32_t)Brick().size());
+			else __label_brick_cells(*brick.cells, brick.labels, brick.cell_counts);
+		});
+
+		uint32_t node_count = 0;
+		for (auto& brick : bricks)
+		{
+			brick.node_offset = node_count;
+			node_count += (uint32_t)brick.cell_counts.size();
+		}
+
+		vector<atomic<uint32_t>> parents(node_count);
+		for (uint32_t node = 0; node < node_count; node++) parents[node].store(node, memory_order_relaxed);
+
+		// cell pairs across the +x, +y & +z face of a brick, the last cell of the brick & the first of the next
+		static const vector<array<pair<int, int>, brick_size * brick_size>> face_cells = []()
+		{
+			vector<array<pair<int, int>, brick_size * brick_size>> cells(3);
+			for (auto v = 0; v < brick_size; v++)
+			{
+				for (auto u = 0; u < brick_size; u++)
+				{
+					cells[0][v * brick_size + u] = make_pair(__brick_cell_index(brick_size - 1, u, v), __brick_cell_index(0, u, v));
+					cells[1][v * brick_size + u] = make_pair(__brick_cell_index(u, brick_size - 1, v), __brick_cell_index(u, 0, v));
+					cells[2][v * brick_size + u] = make_pair(__brick_cell_index(u, v, brick_size - 1), __brick_cell_index(u, v, 0));
+				}
+			}
+			return cells;
+		}();
+
+		// join the facing cells of the next brick along x, y & z
+		__parallel_for(bricks.size(), partition_count, [&](const size_t brick_idx)
+		{
+			auto& brick = bricks[brick_idx];
+			auto node_of = [](const IslandBrick& b, const int cell_idx)
+			{
+				auto label = b.labels.empty() ? 0 : b.labels[cell_idx];
+				return label == island_empty_label ? UINT32_MAX : b.node_offset + label;
+			};
+
+			for (auto axis = 0; axis < 3; axis++)
+			{
+				Point3i next_position = brick.position;
+				if (axis == 0) next_position.x++;
+				else if (axis == 1) next_position.y++;
+				else next_position.z++;
+
+				auto found = brick_indices.find(encode_morton_key(next_position.x, next_position.y, next_position.z));
+				if (found == brick_indices.end()) continue;
+				auto& next_brick = bricks[found->second];
+
+				// neighbouring face cells mostly share their components, skip the pair when nothing changed
+				auto previous = make_pair(UINT32_MAX, UINT32_MAX);
+				for (const auto& cell_pair : face_cells[axis])
+				{
+					auto nodes = make_pair(node_of(brick, cell_pair.first), node_of(next_brick, cell_pair.second));
+					if (nodes.first == UINT32_MAX || nodes.second == UINT32_MAX || nodes == previous) continue;
+
+					__unite_islands(parents, nodes.first, nodes.second);
+					previous = nodes;
+				}
+			}
+		});
+
+		vector<size_t> component_sizes(node_count, 0);
+		for (const auto& brick : bricks)
+		{
+			for (uint32_t label = 0; label < brick.cell_counts.size(); label++)
+			{
+				component_sizes[__find_island_root(parents, brick.node_offset + label)] += brick.cell_counts[label];
+			}
+		}
+
+		auto largest_root = (uint32_t)(max_element(component_sizes.begin(), component_sizes.end()) - component_sizes.begin());
+		auto is_kept = [&](const uint32_t node)
+		{
+			auto root = __find_island_root(parents, node);
+			return component_sizes[root] >= filter.min_cell_count && (!filter.keep_largest || root == largest_root);
+		};
+
+		size_t removed_count = 0;
+		for (const auto& brick : bricks)
+		{
+			vector<bool> kept_labels(brick.cell_counts.size());
+			auto all_kept = true;
+			for (uint32_t label = 0; label < brick.cell_counts.size(); label++)
+			{
+				kept_labels[label] = is_kept(brick.node_offset + label);
+				if (!kept_labels[label]) removed_count += brick.cell_counts[label];
+				all_kept = all_kept && kept_labels[label];
+			}
+			if (all_kept) continue;
+
+			Brick cells;
+			for (auto cell_idx = 0; cell_idx < (int)brick.labels.size(); cell_idx++)
+			{
+				auto label = brick.labels[cell_idx];
+				if (label != island_empty_label && kept_labels[label]) cells.set(cell_idx);
+			}
+			volume.set_brick(brick.position.x, brick.position.y, brick.position.z, cells);
+		}
+
+		return removed_count;
+	}
+
+	// remove inner point cloud & optimize for surface rendering
+	template <typename TVolume>
+	void find_surface_vertices(const TVolume& volume, PointCloud& out_point_cloud, NormalSet& out_normal_set)
+	{
+		RC_TRACE_SCOPE("find_surface_vertices");
+
+		VolumeReader<TVolume> reader(volume);
+
+		// a face always starts at a filled cube corner, so only the filled cells are visited, in morton order
+		volume.for_each_cell([&](const int x, const int y, const int z)
+		{
+#pragma region front
+			Cube cube
+			{
+				vector<bool>{
+					reader.at(x, y + 1, z),
+					reader.at(x + 1, y + 1, z),
+					reader.at(x + 1, y, z),
+					reader.at(x, y, z)
+				},
+				vector<bool>
+				{
+					reader.at(x, y + 1, z + 1),
+					reader.at(x + 1, y + 1, z + 1),
+					reader.at(x + 1, y, z + 1),
+					reader.at(x, y, z + 1)
+				}
+			};
+
+			vector<bool> face_points
+			{
+				reader.at(x, y + 1, z - 1),
+				reader.at(x + 1, y + 1, z - 1),
+				reader.at(x + 1, y, z - 1),
+				reader.at(x, y, z - 1)
+			};
+
+			if (__surface_condition_check(cube, face_points))
+			{
+				out_point_cloud.push_back(__lattice_point(x, y + 1, z));
+				out_point_cloud.push_back(__lattice_point(x + 1, y + 1, z));
+				out_point_cloud.push_back(__lattice_point(x + 1, y, z));
+				out_point_cloud.push_back(__lattice_point(x, y, z));
+
+				out_normal_set.push_back(Normal{ 0, 0, -1 });
+			}
 #pragma endregion
 
 #pragma region back
-					cube = Cube
-					{
-						vector<bool>
-						{
-							volume[x + cube_size][y + cube_size][z + cube_size],
-							volume[x][y + cube_size][z + cube_size],
-							volume[x][y][z + cube_size],
-							volume[x + cube_size][y][z + cube_size]
-						},
-						vector<bool>
-						{
-							volume[x + cube_size][y + cube_size][z],
-							volume[x][y + cube_size][z],
-							volume[x][y][z],
-							volume[x + cube_size][y][z]
-						}
-					};
+			cube = Cube
+			{
+				vector<bool>
+				{
+					reader.at(x + 1, y + 1, z + 1),
+					reader.at(x, y + 1, z + 1),
+					reader.at(x, y, z + 1),
+					reader.at(x + 1, y, z + 1)
+				},
+				vector<bool>
+				{
+					reader.at(x + 1, y + 1, z),
+					reader.at(x, y + 1, z),
+					reader.at(x, y, z),
+					reader.at(x + 1, y, z)
+				}
+			};
 
-					face_points = vector<bool>
-					{
-						volume[x + cube_size][y + cube_size][z + cube_size * 2],
-						volume[x][y + cube_size][z + cube_size * 2],
-						volume[x][y][z + cube_size * 2],
-						volume[x + cube_size][y][z + cube_size * 2]
-					};
+			face_points = vector<bool>
+			{
+				reader.at(x + 1, y + 1, z + 2),
+				reader.at(x, y + 1, z + 2),
+				reader.at(x, y, z + 2),
+				reader.at(x + 1, y, z + 2)
+			};
 
-					if (__surface_condition_check(cube, face_points))
-					{
-						out_point_cloud.push_back(Point3d(x + cube_size, y + cube_size, z + cube_size));
-						out_point_cloud.push_back(Point3d(x, y + cube_size, z + cube_size));
-						out_point_cloud.push_back(Point3d(x, y, z + cube_size));
-						out_point_cloud.push_back(Point3d(x + cube_size, y, z + cube_size));
+			if (__surface_condition_check(cube, face_points))
+			{
+				out_point_cloud.push_back(__lattice_point(x + 1, y + 1, z + 1));
+				out_point_cloud.push_back(__lattice_point(x, y + 1, z + 1));
+				out_point_cloud.push_back(__lattice_point(x, y, z + 1));
+				out_point_cloud.push_back(__lattice_point(x + 1, y, z + 1));
 
-						out_normal_set.push_back(Normal{ 0, 0, 1 });
-					}
+				out_normal_set.push_back(Normal{ 0, 0, 1 });
+			}
 #pragma endregion
 
 #pragma region left
-					cube = Cube
-					{
-						vector<bool>
-						{
-							volume[x][y + cube_size][z + cube_size],
-							volume[x][y + cube_size][z],
-							volume[x][y][z],
-							volume[x][y][z + cube_size]
-						},
-						vector<bool>
-						{
-							volume[x + cube_size][y + cube_size][z + cube_size],
-							volume[x + cube_size][y + cube_size][z],
-							volume[x + cube_size][y][z],
-							volume[x + cube_size][y][z + cube_size]
-						}
-					};
+			cube = Cube
+			{
+				vector<bool>
+				{
+					reader.at(x, y + 1, z + 1),
+					reader.at(x, y + 1, z),
+					reader.at(x, y, z),
+					reader.at(x, y, z + 1)
+				},
+				vector<bool>
+				{
+					reader.at(x + 1, y + 1, z + 1),
+					reader.at(x + 1, y + 1, z),
+					reader.at(x + 1, y, z),
+					reader.at(x + 1, y, z + 1)
+				}
+			};
 
-					face_points = vector<bool>
-					{
-						volume[x - cube_size][y + cube_size][z + cube_size],
-						volume[x - cube_size][y + cube_size][z],
-						volume[x - cube_size][y][z],
-						volume[x - cube_size][y][z + cube_size],
-					};
+			face_points = vector<bool>
+			{
+				reader.at(x - 1, y + 1, z + 1),
+				reader.at(x - 1, y + 1, z),
+				reader.at(x - 1, y, z),
+				reader.at(x - 1, y, z + 1),
+			};
 
-					if (__surface_condition_check(cube, face_points))
-					{
-						out_point_cloud.push_back(Point3d(x, y + cube_size, z + cube_size));
-						out_point_cloud.push_back(Point3d(x, y + cube_size, z));
-						out_point_cloud.push_back(Point3d(x, y, z));
-						out_point_cloud.push_back(Point3d(x, y, z + cube_size));
+			if (__surface_condition_check(cube, face_points))
+			{
+				out_point_cloud.push_back(__lattice_point(x, y + 1, z + 1));
+				out_point_cloud.push_back(__lattice_point(x, y + 1, z));
+				out_point_cloud.push_back(__lattice_point(x, y, z));
+				out_point_cloud.push_back(__lattice_point(x, y, z + 1));
 
-						out_normal_set.push_back(Normal{ -1, 0, 0 });
-					}
+				out_normal_set.push_back(Normal{ -1, 0, 0 });
+			}
 #pragma endregion
 
 #pragma region right
-					cube = Cube
-					{
-						vector<bool>
-						{
-							volume[x + cube_size][y + cube_size][z],
-							volume[x + cube_size][y + cube_size][z + cube_size],
-							volume[x + cube_size][y][z + cube_size],
-							volume[x + cube_size][y][z]
-						},
-						vector<bool>
-						{
-							volume[x][y + cube_size][z],
-							volume[x][y + cube_size][z + cube_size],
-							volume[x][y][z + cube_size],
-							volume[x][y][z]
-						}
-					};
+			cube = Cube
+			{
+				vector<bool>
+				{
+					reader.at(x + 1, y + 1, z),
+					reader.at(x + 1, y + 1, z + 1),
+					reader.at(x + 1, y, z + 1),
+					reader.at(x + 1, y, z)
+				},
+				vector<bool>
+				{
+					reader.at(x, y + 1, z),
+					reader.at(x, y + 1, z + 1),
+					reader.at(x, y, z + 1),
+					reader.at(x, y, z)
+				}
+			};
 
-					face_points = vector<bool>
-					{
-						volume[x + cube_size * 2][y + cube_size][z],
-						volume[x + cube_size * 2][y + cube_size][z + cube_size],
-						volume[x + cube_size * 2][y][z + cube_size],
-						volume[x + cube_size * 2][y][z]
-					};
+			face_points = vector<bool>
+			{
+				reader.at(x + 2, y + 1, z),
+				reader.at(x + 2, y + 1, z + 1),
+				reader.at(x + 2, y, z + 1),
+				reader.at(x + 2, y, z)
+			};
 
-					if (__surface_condition_check(cube, face_points))
-					{
-						out_point_cloud.push_back(Point3d(x + cube_size, y + cube_size, z));
-						out_point_cloud.push_back(Point3d(x + cube_size, y + cube_size, z + cube_size));
-						out_point_cloud.push_back(Point3d(x + cube_size, y, z + cube_size));
-						out_point_cloud.push_back(Point3d(x + cube_size, y, z));
+			if (__surface_condition_check(cube, face_points))
+			{
+				out_point_cloud.push_back(__lattice_point(x + 1, y + 1, z));
+				out_point_cloud.push_back(__lattice_point(x + 1, y + 1, z + 1));
+				out_point_cloud.push_back(__lattice_point(x + 1, y, z + 1));
+				out_point_cloud.push_back(__lattice_point(x + 1, y, z));
 
-						out_normal_set.push_back(Normal{ 1, 0, 0 });
-					}
+				out_normal_set.push_back(Normal{ 1, 0, 0 });
+			}
 #pragma endregion
 
 #pragma region top
-					cube = Cube
-					{
-						vector<bool>
-						{
-							volume[x][y + cube_size][z + cube_size],
-							volume[x + cube_size][y + cube_size][z + cube_size],
-							volume[x + cube_size][y + cube_size][z],
-							volume[x][y + cube_size][z]
-						},
-						vector<bool>
-						{
-							volume[x][y][z + cube_size],
-							volume[x + cube_size][y][z + cube_size],
-							volume[x + cube_size][y][z],
-							volume[x][y][z]
-						}
-					};
+			cube = Cube
+			{
+				vector<bool>
+				{
+					reader.at(x, y + 1, z + 1),
+					reader.at(x + 1, y + 1, z + 1),
+					reader.at(x + 1, y + 1, z),
+					reader.at(x, y + 1, z)
+				},
+				vector<bool>
+				{
+					reader.at(x, y, z + 1),
+					reader.at(x + 1, y, z + 1),
+					reader.at(x + 1, y, z),
+					reader.at(x, y, z)
+				}
+			};
 
-					face_points = vector<bool>
-					{
-						volume[x][y + cube_size * 2][z + cube_size],
-						volume[x + cube_size][y + cube_size * 2][z + cube_size],
-						volume[x + cube_size][y + cube_size * 2][z],
-						volume[x][y + cube_size * 2][z]
-					};
+			face_points = vector<bool>
+			{
+				reader.at(x, y + 2, z + 1),
+				reader.at(x + 1, y + 2, z + 1),
+				reader.at(x + 1, y + 2, z),
+				reader.at(x, y + 2, z)
+			};
 
-					if (__surface_condition_check(cube, face_points))
-					{
-						out_point_cloud.push_back(Point3d(x, y + cube_size, z + cube_size));
-						out_point_cloud.push_back(Point3d(x + cube_size, y + cube_size, z + cube_size));
-						out_point_cloud.push_back(Point3d(x + cube_size, y + cube_size, z));
-						out_point_cloud.push_back(Point3d(x, y + cube_size, z));
+			if (__surface_condition_check(cube, face_points))
+			{
+				out_point_cloud.push_back(__lattice_point(x, y + 1, z + 1));
+				out_point_cloud.push_back(__lattice_point(x + 1, y + 1, z + 1));
+				out_point_cloud.push_back(__lattice_point(x + 1, y + 1, z));
+				out_point_cloud.push_back(__lattice_point(x, y + 1, z));
 
-						out_normal_set.push_back(Normal{ 0, 1, 0 });
-					}
+				out_normal_set.push_back(Normal{ 0, 1, 0 });
+			}
 #pragma endregion
 
 #pragma region bottom
-					cube = Cube
-					{
-						vector<bool>
-						{
-							volume[x + cube_size][y][z + cube_size],
-							volume[x][y][z + cube_size],
-							volume[x][y][z],
-							volume[x + cube_size][y][z]
-						},
-						vector<bool>
-						{
-							volume[x + cube_size][y + cube_size][z + cube_size],
-							volume[x][y + cube_size][z + cube_size],
-							volume[x][y + cube_size][z],
-							volume[x + cube_size][y + cube_size][z]
-						}
-					};
+			cube = Cube
+			{
+				vector<bool>
+				{
+					reader.at(x + 1, y, z + 1),
+					reader.at(x, y, z + 1),
+					reader.at(x, y, z),
+					reader.at(x + 1, y, z)
+				},
+				vector<bool>
+				{
+					reader.at(x + 1, y + 1, z + 1),
+					reader.at(x, y + 1, z + 1),
+					reader.at(x, y + 1, z),
+					reader.at(x + 1, y + 1, z)
+				}
+			};
 
-					face_points = vector<bool>
-					{
-						volume[x + cube_size][y - cube_size][z + cube_size],
-						volume[x][y - cube_size][z + cube_size],
-						volume[x][y - cube_size][z],
-						volume[x + cube_size][y - cube_size][z]
-					};
+			face_points = vector<bool>
+			{
+				reader.at(x + 1, y - 1, z + 1),
+				reader.at(x, y - 1, z + 1),
+				reader.at(x, y - 1, z),
+				reader.at(x + 1, y - 1, z)
+			};
 
-					if (__surface_condition_check(cube, face_points))
-					{
-						out_point_cloud.push_back(Point3d(x + cube_size, y, z + cube_size));
-						out_point_cloud.push_back(Point3d(x, y, z + cube_size));
-						out_point_cloud.push_back(Point3d(x, y, z));
-						out_point_cloud.push_back(Point3d(x + cube_size, y, z));
+			if (__surface_condition_check(cube, face_points))
+			{
+				out_point_cloud.push_back(__lattice_point(x + 1, y, z + 1));
+				out_point_cloud.push_back(__lattice_point(x, y, z + 1));
+				out_point_cloud.push_back(__lattice_point(x, y, z));
+				out_point_cloud.push_back(__lattice_point(x + 1, y, z));
 
-						out_normal_set.push_back(Normal{ 0, 1, 0 });
-					}
-#pragma endregion
-				}
+				out_normal_set.push_back(Normal{ 0, 1, 0 });
 			}
-		}
+#pragma endregion
+		});
+	}
 
-		__convert_point_cloud_origin_form(out_point_cloud, PointCloudOriginForm::_3D, image_size);
+	// world coordinate of a lattice point
+	Point3f get_world_point(const LatticePoint& point, const Lattice& lattice)
+	{
+		return Point3f(
+			lattice.origin.x + point.x * lattice.cube_size,
+			lattice.origin.y + point.y * lattice.cube_size,
+			lattice.origin.z + point.z * lattice.cube_size
+		);
 	}
 
-	// convert point cloud to volume
-	void convert_point_cloud_to_volume(const PointCloud& point_cloud, Volume& out_volume, const Size image_size)
+	// interleave the bits of the cell indices (z-order)
+	MortonKey encode_morton_key(const LatticePoint& point)
 	{
-		out_volume = Volume(image_size.width, vector<vector<bool>>(image_size.height, vector<bool>(image_size.height, false)));
-		for (const auto point : point_cloud)
-		{
-			out_volume[point.x][point.y][point.z] = true;
-		}
+		return encode_morton_key(point.x, point.y, point.z);
+	}
+
+	// interleave the bits of the cell indices (z-order)
+	MortonKey encode_morton_key(const int x, const int y, const int z)
+	{
+		return __spread_morton_bits(x) | (__spread_morton_bits(y) << 1) | (__spread_morton_bits(z) << 2);
+	}
+
+	// cell indices of a morton key
+	LatticePoint decode_morton_key(const MortonKey key)
+	{
+		return __lattice_point((int)__compact_morton_bits(key), (int)__compact_morton_bits(key >> 1), (int)__compact_morton_bits(key >> 2));
 	}
 
 	// extract contours (feature points)
-	void __extract_contours(const ImageSrcSet& image_src_set, ContoursSet& out_contours_set)
+	void __extract_contours(const ImageSet& image_set, ContoursSet& out_contours_set)
 	{
-		for (auto const &img : image_src_set)
+		for (auto const &img : image_set)
 		{
-			auto img_gray = imread(img.second, IMREAD_GRAYSCALE);
+			RC_TRACE_SCOPE("extract_contours");
+
+			auto& img_gray = img.second;
 
 			Mat img_detected;
 			// pre-process image before canny edge detect
@@ -483,6 +1424,17 @@ namespace rc
 		}
 	}
 
+	// check if a full resolution pixel is part of a (possibly reduced) shape
+	bool __is_shape_pixel(const Shape& shape, const int x, const int y, const int scale)
+	{
+		if (shape.empty()) return false;
+
+		// reduced decodes may round the size down, so clamp to the first & last row & column
+		auto row = max(min(y / scale, shape.rows - 1), 0);
+		auto col = max(min(x / scale, shape.cols - 1), 0);
+		return shape.at<Vec3b>(row, col) != Vec3b(0, 0, 0);
+	}
+
 	// check if the vectices can construct a surface
 	bool __surface_condition_check(const Cube cube, const vector<bool> face_points)
 	{
@@ -511,97 +1463,252 @@ namespace rc
 				|| condition_11 || condition_12 || condition_13);
 	}
 
-	// covert point cloud origin form (2D <-> 3D)
-	void __convert_point_cloud_origin_form(PointCloud& point_cloud, const PointCloudOriginForm origin_form, const Size image_size)
+	// area & crack perimeter (the edges between shape & background pixels, i.e. the staircase the lattice sees)
+	void __measure_shape(const Shape& shape, const int scale, double& out_area, double& out_perimeter)
+	{
+		size_t pixel_count = 0, edge_count = 0;
+		for (auto y = 0; y < shape.rows; y++)
+		{
+			for (auto x = 0; x < shape.cols; x++)
+			{
+				bool filled = shape.at<Vec3b>(y, x) != Vec3b(0, 0, 0);
+				bool right = x + 1 < shape.cols && shape.at<Vec3b>(y, x + 1) != Vec3b(0, 0, 0);
+				bool below = y + 1 < shape.rows && shape.at<Vec3b>(y + 1, x) != Vec3b(0, 0, 0);
+
+				if (filled) pixel_count++;
+				if (filled != right) edge_count++;
+				if (filled != below) edge_count++;
+				if (filled && x == 0) edge_count++;
+				if (filled && y == 0) edge_count++;
+			}
+		}
+
+		out_area = (double)pixel_count * scale * scale;
+		out_perimeter = (double)edge_count * scale;
+	}
+
+	bool __fits_budget(const CarvingEstimate& estimate, const CarvingBudget& budget)
 	{
-		int t_x = origin_form == PointCloudOriginForm::_3D ? -image_size.width / 2 : image_size.width / 2;
-		int t_y = origin_form == PointCloudOriginForm::_3D ? -image_size.height / 2 : image_size.height / 2;
-		int t_z = origin_form == PointCloudOriginForm::_3D ? -image_size.height / 2 : image_size.height / 2;
-		__transform_point_cloud(point_cloud, Point3d(t_x, t_y, t_z));
+		return (budget.seconds <= 0 || estimate.seconds <= budget.seconds) &&
+			(budget.memory_size <= 0 || estimate.memory_size <= budget.memory_size) &&
+			(budget.triangle_count <= 0 || 2 * estimate.face_count <= budget.triangle_count);
 	}
 
-	// point cloud X-axis rotation
-	void __rotate_point_cloud_x_axis(PointCloud& point_cloud, float degree)
+	// check if the sample is part of the object in every view, samples outside of the images are not
+	bool __is_carved_pixel(const OthProjection& othogonal_projection, const Size image_size, const int x, const int y, const int z)
 	{
-		float beta = degree * CV_PI / 180;
+		auto left_x = z + image_size.width / 2 - image_size.height / 2;
+		if (x < 0 || x >= image_size.width || y < 0 || y >= image_size.height || z < 0 || z >= image_size.height) return false;
+		if (left_x < 0 || left_x >= image_size.width) return false;
+
+		auto scale = othogonal_projection.scale;
+		return __is_shape_pixel(othogonal_projection.front, x, y, scale) &&
+			__is_shape_pixel(othogonal_projection.top, x, z, scale) &&
+			__is_shape_pixel(othogonal_projection.left, left_x, y, scale);
+	}
 
-		// Y-axis rotation matrix
-		Mat R = (Mat_<float>(4, 4) <<
-			1, 0, 0, 0,
-			0, cos(beta), -sin(beta), 0,
-			0, sin(beta), cos(beta), 0,
-			0, 0, 0, 1);
+	void __create_shape_sum_table(const Shape& shape, ShapeSumTable& out_table)
+	{
+		out_table.size = shape.size();
+		out_table.sums.assign((size_t)(shape.rows + 1) * (shape.cols + 1), 0);
 
-		// perform rotation to the point cloud
-		for (auto i = 0; i < point_cloud.size(); i++)
+		for (auto row = 0; row < shape.rows; row++)
 		{
-			// covert Point3d into Mat
-			Mat p_mat = (Mat_<float>(4, 1) <<
-				point_cloud[i].x,
-				point_cloud[i].y,
-				point_cloud[i].z,
-				1);
+			auto pixels = shape.ptr<uchar>(row);
+			auto above = &out_table.sums[(size_t)row * (shape.cols + 1) + 1];
+			auto sums = above + shape.cols + 1;
+			auto row_sum = 0;
+			for (auto col = 0; col < shape.cols; col++, pixels += 3)
+			{
+				row_sum += (pixels[0] | pixels[1] | pixels[2]) != 0;
+				sums[col] = above[col] + row_sum;
+			}
+		}
+	}
 
-			Mat result = R * p_mat;
+	// the full resolution rectangle [u_first, u_last] x [v_first, v_last] inside the image, mapped like __is_shape_pixel.
+	// the whole rectangle is counted, so inside & outside hold for every sample within it
+	FootprintClass __classify_footprint(const ShapeSumTable& table, const int scale, const int u_first, const int u_last, const int v_first, const int v_last)
+	{
+		if (table.size.area() == 0) return footprint_outside;
 
-			// assign the result back to the point cloud
-			point_cloud[i] = Point3d(roundf(result.at<float>(0, 0)), roundf(result.at<float>(1, 0)), roundf(result.at<float>(2, 0)));
-		}
+		auto col_first = min(u_first / scale, table.size.width - 1), col_last = min(u_last / scale, table.size.width - 1) + 1;
+		auto row_first = min(v_first / scale, table.size.height - 1), row_last = min(v_last / scale, table.size.height - 1) + 1;
+		auto stride = (size_t)table.size.width + 1;
+
+		auto filled_count = table.sums[row_last * stride + col_last] - table.sums[row_first * stride + col_last]
+			- table.sums[row_last * stride + col_first] + table.sums[row_first * stride + col_first];
+		if (filled_count == 0) return footprint_outside;
+		return filled_count == (col_last - col_first) * (row_last - row_first) ? footprint_inside : footprint_mixed;
 	}
 
-	// point cloud Y-axis rotation
-	void __rotate_point_cloud_y_axis(PointCloud& point_cloud, float degree)
+	// lattice point from cell indices
+	LatticePoint __lattice_point(const int x, const int y, const int z)
 	{
-		float beta = degree * CV_PI / 180;
+		return LatticePoint{ (uint16_t)x, (uint16_t)y, (uint16_t)z };
+	}
+
+	// spread the lower 16 bits of the value to every third bit
+	MortonKey __spread_morton_bits(MortonKey value)
+	{
+		value &= 0xFFFF;
+		value = (value | (value << 16)) & 0x0000FF0000FFull;
+		value = (value | (value << 8)) & 0x00F00F00F00Full;
+		value = (value | (value << 4)) & 0x0C30C30C30C3ull;
+		value = (value | (value << 2)) & 0x249249249249ull;
+		return value;
+	}
+
+	// gather every third bit of the value into the lower 16 bits
+	MortonKey __compact_morton_bits(MortonKey value)
+	{
+		value &= 0x249249249249ull;
+		value = (value ^ (value >> 2)) & 0x0C30C30C30C3ull;
+		value = (value ^ (value >> 4)) & 0x00F00F00F00Full;
+		value = (value ^ (value >> 8)) & 0x0000FF0000FFull;
+		value = (value ^ (value >> 16)) & 0xFFFF;
+		return value;
+	}
+
+	// morton index of a cell inside its brick
+	int __brick_cell_index(const int x, const int y, const int z)
+	{
+		return (int)encode_morton_key(x % brick_size, y % brick_size, z % brick_size);
+	}
+
+	// components of the filled cells inside one brick, with a small union-find over the runs of cells along x
+	void __label_brick_cells(const Brick& cells, vector<uint16_t>& out_labels, vector<uint32_t>& out_cell_counts)
+	{
+		const int row_count = brick_size * brick_size;
+		const int max_run_count = row_count * brick_size / 2;
+
+		// the 2 x 2 x 2 blocks of the morton order, every block fills 2 bits of 4 rows
+		static const vector<pair<int, int>> block_rows = []()
+		{
+			vector<pair<int, int>> rows(row_count);
+			for (auto block_idx = 0; block_idx < row_count; block_idx++)
+			{
+				auto block = decode_morton_key((MortonKey)block_idx);
+				rows[block_idx] = make_pair(2 * block.y + 2 * block.z * brick_size, 2 * block.x);
+			}
+			return rows;
+		}();
+		static const Brick word_mask(~0ULL);
 
-		// Y-axis rotation matrix
-		Mat R = (Mat_<float>(4, 4) <<
-			cos(beta), 0, -sin(beta), 0,
-			0, 1, 0, 0,
-			sin(beta), 0, cos(beta), 0,
-			0, 0, 0, 1);
+		// the cells as rows along x, row y + z * brick_size, one bit per cell
+		uint8_t rows[row_count] = {};
+		for (auto word_idx = 0; word_idx < (int)cells.size() / 64; word_idx++)
+		{
+			auto word = ((cells >> (64 * word_idx)) & word_mask).to_ullong();
+			for (auto byte_idx = 0; byte_idx < 8 && word != 0; byte_idx++, word >>= 8)
+			{
+				auto block = (uint32_t)(word & 0xFF);
+				if (block == 0) continue;
+
+				auto& target = block_rows[word_idx * 8 + byte_idx];
+				rows[target.first] |= (uint8_t)((block & 3) << target.second);
+				rows[target.first + 1] |= (uint8_t)(((block >> 2) & 3) << target.second);
+				rows[target.first + brick_size] |= (uint8_t)(((block >> 4) & 3) << target.second);
+				rows[target.first + brick_size + 1] |= (uint8_t)(((block >> 6) & 3) << target.second);
+			}
+		}
+
+		// runs of filled cells along the rows, the runs of row r start at run_first[r]
+		uint8_t run_masks[max_run_count];
+		uint8_t run_rows[max_run_count];
+		uint16_t run_first[row_count + 1];
+		auto run_count = 0;
+		for (auto row = 0; row < row_count; row++)
+		{
+			run_first[row] = (uint16_t)run_count;
+			for (uint32_t bits = rows[row]; bits != 0; )
+			{
+				auto run = bits & ~(bits + (bits & (0u - bits)));
+				run_masks[run_count] = (uint8_t)run;
+				run_rows[run_count++] = (uint8_t)row;
+				bits &= ~run;
+			}
+		}
+		run_first[row_count] = (uint16_t)run_count;
+
+		uint16_t parents[max_run_count];
+		for (auto run_idx = 0; run_idx < run_count; run_idx++) parents[run_idx] = (uint16_t)run_idx;
+
+		auto find_root = [&](int run_idx)
+		{
+			while (parents[run_idx] != run_idx) run_idx = parents[run_idx] = parents[parents[run_idx]];
+			return run_idx;
+		};
 
-		// perform rotation to the point cloud
-		for (auto i = 0; i < point_cloud.size(); i++)
+		// runs touch the overlapping runs of the -y & -z rows
+		for (auto run_idx = 0; run_idx < run_count; run_idx++)
 		{
-			// covert Point3d into Mat
-			Mat p_mat = (Mat_<float>(4, 1) <<
-				point_cloud[i].x,
-				point_cloud[i].y,
-				point_cloud[i].z,
-				1);
+			auto row = run_rows[run_idx];
+			for (auto lower_row : { row % brick_size > 0 ? row - 1 : -1, row >= brick_size ? row - brick_size : -1 })
+			{
+				if (lower_row < 0) continue;
 
-			Mat result = R * p_mat;
+				for (auto lower_idx = run_first[lower_row]; lower_idx < run_first[lower_row + 1]; lower_idx++)
+				{
+					if (!(run_masks[lower_idx] & run_masks[run_idx])) continue;
 
-			// assign the result back to the point cloud
-			point_cloud[i] = Point3d(roundf(result.at<float>(0, 0)), roundf(result.at<float>(1, 0)), roundf(result.at<float>(2, 0)));
+					auto a = find_root(run_idx), b = find_root(lower_idx);
+					if (a != b) parents[max(a, b)] = (uint16_t)min(a, b);
+				}
+			}
+		}
+
+		// roots are the first run of their component, so they are labelled first
+		uint16_t run_labels[max_run_count];
+		out_labels.assign(cells.size(), island_empty_label);
+		out_cell_counts.clear();
+		for (auto run_idx = 0; run_idx < run_count; run_idx++)
+		{
+			auto root = find_root(run_idx);
+			if (root == run_idx)
+			{
+				run_labels[run_idx] = (uint16_t)out_cell_counts.size();
+				out_cell_counts.push_back(0);
+			}
+			auto label = run_labels[run_idx] = run_labels[root];
+
+			auto y = run_rows[run_idx] % brick_size, z = run_rows[run_idx] / brick_size;
+			for (auto x = 0; x < brick_size; x++)
+			{
+				if (!(run_masks[run_idx] >> x & 1)) continue;
+
+				out_labels[__brick_cell_index(x, y, z)] = label;
+				out_cell_counts[label]++;
+			}
 		}
 	}
 
-	// point cloud transform
-	void __transform_point_cloud(PointCloud & point_cloud, Point3d distance)
+	// path halving, safe while other threads unite
+	uint32_t __find_island_root(vector<atomic<uint32_t>>& parents, uint32_t node)
 	{
-		// transformation matrix
-		Mat T = (Mat_<float>(4, 4) <<
-			1, 0, 0, distance.x,
-			0, 1, 0, distance.y,
-			0, 0, 1, distance.z,
-			0, 0, 0, 1);
-
-		// perform transformation to the point cloud
-		for (auto i = 0; i < point_cloud.size(); i++)
+		while (true)
 		{
-			// covert Point3d into Mat
-			Mat p_mat = (Mat_<float>(4, 1) <<
-				point_cloud[i].x,
-				point_cloud[i].y,
-				point_cloud[i].z,
-				1);
+			auto parent = parents[node].load(memory_order_acquire);
+			if (parent == node) return node;
 
-			Mat result = T * p_mat;
+			auto grandparent = parents[parent].load(memory_order_acquire);
+			if (grandparent != parent) parents[node].compare_exchange_weak(parent, grandparent, memory_order_acq_rel);
+			node = grandparent;
+		}
+	}
+
+	// the larger root is linked below the smaller one, retried when another thread moved it first
+	void __unite_islands(vector<atomic<uint32_t>>& parents, uint32_t a, uint32_t b)
+	{
+		while (true)
+		{
+			a = __find_island_root(parents, a);
+			b = __find_island_root(parents, b);
+			if (a == b) return;
+			if (a < b) swap(a, b);
 
-			// assign the result back to the point cloud
-			point_cloud[i] = Point3d(result.at<float>(0, 0), result.at<float>(1, 0), result.at<float>(2, 0));
+			auto expected = a;
+			if (parents[a].compare_exchange_strong(expected, b, memory_order_acq_rel)) return;
 		}
 	}
 
@@ -0,0 +1,186 @@
+#pragma once
+#ifndef SCHEDULER_H
+#define SCHEDULER_H
+
+#include <atomic>
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+#include "trace.h"
+
+using namespace std;
+
+namespace scheduler
+{
+	typedef function<void()> Task;
+
+	// thread pool where every worker owns a task deque, the owner works LIFO from the back
+	// (cache-hot follow-up stages) and idle workers steal FIFO from the front of the others
+	class WorkStealingPool
+	{
+	public:
+		explicit WorkStealingPool(size_t thread_count = thread::hardware_concurrency())
+		{
+			thread_count = max<size_t>(thread_count, 1);
+
+			for (size_t i = 0; i < thread_count; i++)
+			{
+				workers.push_back(make_unique<Worker>());
+			}
+
+			for (size_t i = 0; i < thread_count; i++)
+			{
+				threads.emplace_back([this, i]() { __run_worker(i); });
+			}
+		}
+
+		~WorkStealingPool()
+		{
+			{
+				lock_guard<mutex> lock(sleep_mutex);
+				stopping = true;
+			}
+			sleep_condition.notify_all();
+
+			for (auto& t : threads) t.join();
+		}
+
+		WorkStealingPool(const WorkStealingPool&) = delete;
+		WorkStealingPool& operator=(const WorkStealingPool&) = delete;
+
+		size_t size() const { return workers.size(); }
+
+		// queue a task, tasks submitted from a worker go to its own deque
+		void submit(Task task)
+		{
+			unfinished_count++;
+
+			auto worker_idx = __current_pool() == this
+				? __current_worker_idx()
+				: next_worker_idx++ % workers.size();
+
+			{
+				lock_guard<mutex> lock(workers[worker_idx]->tasks_mutex);
+				workers[worker_idx]->tasks.push_back(move(task));
+			}
+			queued_count++;
+
+			{
+				lock_guard<mutex> lock(sleep_mutex);
+			}
+			sleep_condition.notify_one();
+		}
+
+		// block until every submitted task, including the ones they submit, has finished
+		void wait_idle()
+		{
+			unique_lock<mutex> lock(idle_mutex);
+			idle_condition.wait(lock, [this]() { return unfinished_count == 0; });
+		}
+
+	private:
+		struct Worker
+		{
+			deque<Task> tasks;
+			mutex tasks_mutex;
+		};
+
+		vector<unique_ptr<Worker>> workers;
+		vector<thread> threads;
+
+		atomic<size_t> queued_count{ 0 };
+		atomic<size_t> unfinished_count{ 0 };
+		atomic<size_t> next_worker_idx{ 0 };
+		bool stopping = false;
+
+		mutex sleep_mutex;
+		condition_variable sleep_condition;
+		mutex idle_mutex;
+		condition_variable idle_condition;
+
+		// function-local, so the header stays safe to include from several translation units
+		static WorkStealingPool*& __current_pool()
+		{
+			static thread_local WorkStealingPool* pool = nullptr;
+			return pool;
+		}
+
+		static size_t& __current_worker_idx()
+		{
+			static thread_local size_t worker_idx = 0;
+			return worker_idx;
+		}
+
+		void __run_worker(const size_t worker_idx)
+		{
+			__current_pool() = this;
+			__current_worker_idx() = worker_idx;
+			RC_TRACE_THREAD_NAME("worker " + to_string(worker_idx));
+
+			while (true)
+			{
+				Task task;
+				if (__pop_task(worker_idx, task) || __steal_task(worker_idx, task))
+				{
+					queued_count--;
+					task();
+
+					if (--unfinished_count == 0)
+					{
+						lock_guard<mutex> lock(idle_mutex);
+						idle_condition.notify_all();
+					}
+					continue;
+				}
+
+				RC_TRACE_SCOPE("worker_idle");
+				unique_lock<mutex> lock(sleep_mutex);
+				sleep_condition.wait(lock, [this]() { return stopping || queued_count > 0; });
+				if (stopping && queued_count == 0) return;
+			}
+		}
+
+		bool __pop_task(const size_t worker_idx, Task& out_task)
+		{
+			auto& worker = *workers[worker_idx];
+			unique_lock<mutex> lock(worker.tasks_mutex, defer_lock);
+			__lock_task_deque(lock);
+			if (worker.tasks.empty()) return false;
+
+			out_task = move(worker.tasks.back());
+			worker.tasks.pop_back();
+			return true;
+		}
+
+		bool __steal_task(const size_t worker_idx, Task& out_task)
+		{
+			for (size_t offset = 1; offset < workers.size(); offset++)
+			{
+				auto& victim = *workers[(worker_idx + offset) % workers.size()];
+				unique_lock<mutex> lock(victim.tasks_mutex, defer_lock);
+				__lock_task_deque(lock);
+				if (victim.tasks.empty()) continue;
+
+				out_task = move(victim.tasks.front());
+				victim.tasks.pop_front();
+				return true;
+			}
+			return false;
+		}
+
+		// only a contended lock shows up in the trace
+		static void __lock_task_deque(unique_lock<mutex>& lock)
+		{
+			if (lock.try_lock()) return;
+
+			RC_TRACE_SCOPE("task_lock_wait");
+			lock.lock();
+		}
+	};
+}
+
+#endif // !SCHEDULER_H
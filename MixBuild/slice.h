@@ -0,0 +1,289 @@
+#pragma once
+#ifndef SLICE_H
+#define SLICE_H
+
+#include <opencv2/opencv.hpp>
+#include <atomic>
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <fstream>
+#include <sstream>
+#include <thread>
+#include "rc.h"
+
+using namespace std;
+using namespace cv;
+
+// layer images for a resin printer, sampled straight from the carved volume.
+// the archive (.zip, stored) holds slice.ini & one png per layer, 00000.png being the bottom layer
+namespace slice
+{
+#pragma region type_declaration
+
+	// the lcd of the printer & the printed size of the model, lengths in mm
+	struct PrinterProfile
+	{
+		int resolution_x = 2560;
+		int resolution_y = 1620;
+		double pixel_size = .05;
+		double layer_height = .05;
+		double model_height = 50;
+	};
+
+	// filled cells of the volume, the first & last cell along every axis
+	struct VolumeBounds
+	{
+		Point3i first = Point3i(INT_MAX, INT_MAX, INT_MAX);
+		Point3i last = Point3i(INT_MIN, INT_MIN, INT_MIN);
+	};
+
+	struct ArchiveEntry
+	{
+		string name;
+		const vector<uint8_t>* data;
+		uint32_t crc;
+		uint32_t offset;
+	};
+
+#pragma endregion
+
+#pragma region methods_declaration
+
+	template <typename TVolume> bool slice_volume(const TVolume& volume, const PrinterProfile& profile, vector<vector<uint8_t>>& out_layer_images, const int thread_count = thread::hardware_concurrency());
+	template <typename TVolume> VolumeBounds measure_volume_bounds(const TVolume& volume);
+	bool write_slice_archive(const vector<vector<uint8_t>>& layer_images, const PrinterProfile& profile, const string path);
+	uint32_t crc32(const uint8_t* data, const size_t size, const uint32_t crc = 0);
+	string __layer_name(const size_t layer_idx);
+	void __write_le(ofstream& ofs, const uint32_t value, const int byte_count);
+
+#pragma endregion
+
+#pragma region methods_definition
+
+	// the model stands on the build plate with the lattice y axis up & is centred on the lcd,
+	// every pixel takes the cell under its centre, the parts past the lcd are cut off
+	template <typename TVolume>
+	bool slice_volume(const TVolume& volume, const PrinterProfile& profile, vector<vector<uint8_t>>& out_layer_images, const int thread_count)
+	{
+		RC_TRACE_SCOPE("slice_volume");
+
+		out_layer_images.clear();
+
+		auto bounds = measure_volume_bounds(volume);
+		if (bounds.first.y > bounds.last.y || profile.resolution_x <= 0 || profile.resolution_y <= 0 ||
+			profile.layer_height <= 0 || profile.pixel_size <= 0 || profile.model_height <= 0) return false;
+
+		// mm per cell
+		double cell_size = profile.model_height / (bounds.last.y - bounds.first.y + 1);
+		auto layer_count = (size_t)ceil(profile.model_height / profile.layer_height);
+
+		// cells under the pixel centres, -1 outside of the model
+		auto map_pixels = [&](const int resolution, const int first, const int last)
+		{
+			vector<int> cells(resolution, -1);
+			double centre = (first + last + 1) / 2.0;
+			for (auto pixel = 0; pixel < resolution; pixel++)
+			{
+				auto cell = (int)floor(centre + (pixel + .5 - resolution / 2.0) * profile.pixel_size / cell_size);
+				if (cell >= first && cell <= last) cells[pixel] = cell;
+			}
+			return cells;
+		};
+		auto column_cells = map_pixels(profile.resolution_x, bounds.first.x, bounds.last.x);
+		auto row_cells = map_pixels(profile.resolution_y, bounds.first.z, bounds.last.z);
+
+		// the columns over the model are contiguous
+		auto first_column = (int)(find_if(column_cells.begin(), column_cells.end(), [](const int cell) { return cell >= 0; }) - column_cells.begin());
+		auto last_column = (int)(column_cells.rend() - find_if(column_cells.rbegin(), column_cells.rend(), [](const int cell) { return cell >= 0; })) - 1;
+
+		out_layer_images.resize(layer_count);
+		atomic<bool> encoded{ true };
+
+		// a partition takes every partition_count-th layer, so the narrow top & bottom layers are spread out
+		auto partition_count = min<size_t>(max(thread_count, 1), layer_count);
+		rc::__parallel_for(partition_count, (int)partition_count, [&](const size_t partition)
+		{
+			RC_TRACE_SCOPE("slice_layers");
+
+			rc::VolumeReader<TVolume> reader(volume);
+			Mat layer(profile.resolution_y, profile.resolution_x, CV_8UC1);
+			vector<uchar> cell_row(bounds.last.x - bounds.first.x + 1);
+
+			for (auto layer_idx = partition; layer_idx < layer_count; layer_idx += partition_count)
+			{
+				auto y = bounds.first.y + (int)floor((layer_idx + .5) * profile.layer_height / cell_size);
+				layer.setTo(Scalar(0));
+
+				// a cell spans several pixels, so every row of cells is read once & repeated
+				for (auto row = 0; row < profile.resolution_y; row++)
+				{
+					auto z = row_cells[row];
+					if (z < 0) continue;
+
+					auto pixels = layer.ptr<uchar>(row);
+					if (row > 0 && row_cells[row - 1] == z)
+					{
+						memcpy(pixels, layer.ptr<uchar>(row - 1), profile.resolution_x);
+						continue;
+					}
+
+					for (auto x = bounds.first.x; x <= bounds.last.x; x++)
+					{
+						cell_row[x - bounds.first.x] = reader.at(x, y, z) ? 255 : 0;
+					}
+					for (auto column = first_column; column <= last_column; column++)
+					{
+						pixels[column] = cell_row[column_cells[column] - bounds.first.x];
+					}
+				}
+
+				if (!imencode(".png", layer, out_layer_images[layer_idx])) encoded = false;
+			}
+		});
+
+		return encoded;
+	}
+
+	template <typename TVolume>
+	VolumeBounds measure_volume_bounds(const TVolume& volume)
+	{
+		VolumeBounds bounds;
+		volume.for_each_cell([&](const int x, const int y, const int z)
+		{
+			bounds.first = Point3i(min(bounds.first.x, x), min(bounds.first.y, y), min(bounds.first.z, z));
+			bounds.last = Point3i(max(bounds.last.x, x), max(bounds.last.y, y), max(bounds.last.z, z));
+		});
+		return bounds;
+	}
+
+	// zip without compression, the pngs are compressed already
+	bool write_slice_archive(const vector<vector<uint8_t>>& layer_images, const PrinterProfile& profile, const string path)
+	{
+		RC_TRACE_SCOPE("write_slice_archive");
+
+		if (layer_images.size() + 1 > UINT16_MAX) return false;
+
+		ostringstream ini;
+		ini << "[printer]" << endl;
+		ini << "resolution_x = " << profile.resolution_x << endl;
+		ini << "resolution_y = " << profile.resolution_y << endl;
+		ini << "pixel_size_mm = " << profile.pixel_size << endl;
+		ini << "[model]" << endl;
+		ini << "layer_height_mm = " << profile.layer_height << endl;
+		ini << "layer_count = " << layer_images.size() << endl;
+		ini << "model_height_mm = " << profile.model_height << endl;
+		auto ini_text = ini.str();
+		vector<uint8_t> ini_data(ini_text.begin(), ini_text.end());
+
+		vector<ArchiveEntry> entries;
+		entries.push_back(ArchiveEntry{ "slice.ini", &ini_data, 0, 0 });
+		for (size_t layer_idx = 0; layer_idx < layer_images.size(); layer_idx++)
+		{
+			entries.push_back(ArchiveEntry{ __layer_name(layer_idx), &layer_images[layer_idx], 0, 0 });
+		}
+
+		ofstream ofs(path, ios::binary);
+		if (!ofs) return false;
+
+		// date 1980-01-01, the earliest a zip can store
+		const uint32_t dos_date = (1 << 5) | 1;
+
+		uint64_t offset = 0;
+		for (auto& entry : entries)
+		{
+			entry.crc = crc32(entry.data->data(), entry.data->size());
+			entry.offset = (uint32_t)offset;
+
+			__write_le(ofs, 0x04034b50, 4); // local file header
+			__write_le(ofs, 20, 2); // version needed
+			__write_le(ofs, 0, 2); // flags
+			__write_le(ofs, 0, 2); // stored
+			__write_le(ofs, 0, 2); // time
+			__write_le(ofs, dos_date, 2);
+			__write_le(ofs, entry.crc, 4);
+			__write_le(ofs, (uint32_t)entry.data->size(), 4);
+			__write_le(ofs, (uint32_t)entry.data->size(), 4);
+			__write_le(ofs, (uint32_t)entry.name.size(), 2);
+			__write_le(ofs, 0, 2); // extra field
+			ofs.write(entry.name.data(), entry.name.size());
+			ofs.write((const char*)entry.data->data(), entry.data->size());
+
+			offset += 30 + entry.name.size() + entry.data->size();
+			if (offset > UINT32_MAX) return false;
+		}
+
+		auto directory_offset = offset;
+		for (const auto& entry : entries)
+		{
+			__write_le(ofs, 0x02014b50, 4); // central directory header
+			__write_le(ofs, 20, 2); // version made by
+			__write_le(ofs, 20, 2); // version needed
+			__write_le(ofs, 0, 2); // flags
+			__write_le(ofs, 0, 2); // stored
+			__write_le(ofs, 0, 2); // time
+			__write_le(ofs, dos_date, 2);
+			__write_le(ofs, entry.crc, 4);
+			__write_le(ofs, (uint32_t)entry.data->size(), 4);
+			__write_le(ofs, (uint32_t)entry.data->size(), 4);
+			__write_le(ofs, (uint32_t)entry.name.size(), 2);
+			__write_le(ofs, 0, 2); // extra field
+			__write_le(ofs, 0, 2); // comment
+			__write_le(ofs, 0, 2); // disk
+			__write_le(ofs, 0, 2); // internal attributes
+			__write_le(ofs, 0, 4); // external attributes
+			__write_le(ofs, entry.offset, 4);
+			ofs.write(entry.name.data(), entry.name.size());
+
+			offset += 46 + entry.name.size();
+		}
+
+		__write_le(ofs, 0x06054b50, 4); // end of central directory
+		__write_le(ofs, 0, 2); // disk
+		__write_le(ofs, 0, 2); // disk of the directory
+		__write_le(ofs, (uint32_t)entries.size(), 2);
+		__write_le(ofs, (uint32_t)entries.size(), 2);
+		__write_le(ofs, (uint32_t)(offset - directory_offset), 4);
+		__write_le(ofs, (uint32_t)directory_offset, 4);
+		__write_le(ofs, 0, 2); // comment
+
+		return ofs.good();
+	}
+
+	// crc-32 of zip & png (reflected polynomial 0xEDB88320), pass the previous crc to continue it
+	uint32_t crc32(const uint8_t* data, const size_t size, const uint32_t crc)
+	{
+		static const vector<uint32_t> table = []()
+		{
+			vector<uint32_t> values(256);
+			for (uint32_t n = 0; n < 256; n++)
+			{
+				auto value = n;
+				for (auto bit = 0; bit < 8; bit++) value = value & 1 ? 0xEDB88320 ^ (value >> 1) : value >> 1;
+				values[n] = value;
+			}
+			return values;
+		}();
+
+		auto value = ~crc;
+		for (size_t i = 0; i < size; i++) value = table[(value ^ data[i]) & 0xFF] ^ (value >> 8);
+		return ~value;
+	}
+
+	// zero padded so the layers sort by name
+	string __layer_name(const size_t layer_idx)
+	{
+		char name[32];
+		snprintf(name, sizeof(name), "%05zu.png", layer_idx);
+		return name;
+	}
+
+	void __write_le(ofstream& ofs, const uint32_t value, const int byte_count)
+	{
+		for (auto i = 0; i < byte_count; i++) ofs.put((char)((value >> (8 * i)) & 0xFF));
+	}
+
+#pragma endregion
+}
+
+#endif // !SLICE_H
@@ -0,0 +1,221 @@
+#pragma once
+#ifndef TRACE_H
+#define TRACE_H
+
+// scoped trace zones, only compiled in with MIXBUILD_TRACE (msbuild /p:EnableTrace=true),
+// otherwise every macro expands to nothing
+#ifdef MIXBUILD_TRACE
+
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <fstream>
+#include <iomanip>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <vector>
+
+using namespace std;
+
+namespace trace
+{
+#pragma region type_declaration
+
+	struct Event
+	{
+		const char* name;
+		int64_t begin; // ns since the trace start
+		int64_t end;
+	};
+
+	// events of one thread, only the owner writes & the oldest events are overwritten when full.
+	// a ring is handed to the next new thread once its owner exits, so its lane may hold several threads
+	struct Ring
+	{
+		static const size_t capacity = 1 << 16;
+
+		uint32_t thread_idx = 0;
+		string thread_name;
+		vector<Event> events = vector<Event>(capacity);
+		atomic<uint64_t> write_count{ 0 };
+		bool in_use = false;
+	};
+
+	// gives the ring of a thread back when the thread exits
+	struct RingLease
+	{
+		Ring* ring = nullptr;
+
+		~RingLease();
+	};
+
+	// records the time between construction & destruction on the current thread
+	struct Zone
+	{
+		const char* name;
+		int64_t begin;
+
+		explicit Zone(const char* name);
+		~Zone();
+
+		Zone(const Zone&) = delete;
+		Zone& operator=(const Zone&) = delete;
+	};
+
+#pragma endregion
+
+#pragma region methods_declaration
+
+	void record(const char* name, const int64_t begin, const int64_t end);
+	void set_thread_name(const string name);
+	bool write_chrome_trace(const string path);
+	int64_t __now();
+	Ring& __thread_ring();
+	void __write_json_string(ofstream& ofs, const string& value);
+
+#pragma endregion
+
+#pragma region methods_definition
+
+	// rings live until the process exits, so threads can finish before the trace is written,
+	// there are as many as threads were alive at once
+	vector<unique_ptr<Ring>> __rings;
+	mutex __rings_mutex;
+	const chrono::steady_clock::time_point __start_time = chrono::steady_clock::now();
+
+	Zone::Zone(const char* name) : name(name), begin(__now()) {}
+
+	Zone::~Zone()
+	{
+		record(name, begin, __now());
+	}
+
+	// lock free, the ring is only written by its own thread
+	void record(const char* name, const int64_t begin, const int64_t end)
+	{
+		auto& ring = __thread_ring();
+		auto count = ring.write_count.load(memory_order_relaxed);
+		ring.events[count % Ring::capacity] = Event{ name, begin, end };
+		ring.write_count.store(count + 1, memory_order_release);
+	}
+
+	// the lane of a reused ring lists the names of all its threads
+	void set_thread_name(const string name)
+	{
+		auto& ring = __thread_ring();
+		lock_guard<mutex> lock(__rings_mutex);
+		if (ring.thread_name.find(name) == string::npos) ring.thread_name += (ring.thread_name.empty() ? "" : ", ") + name;
+	}
+
+	// chrome trace event json, open with chrome://tracing or ui.perfetto.dev,
+	// call it once the traced threads are idle
+	bool write_chrome_trace(const string path)
+	{
+		ofstream ofs(path);
+		if (!ofs) return false;
+
+		lock_guard<mutex> lock(__rings_mutex);
+
+		ofs << fixed << setprecision(3);
+		ofs << "{\"displayTimeUnit\":\"ms\",\"traceEvents\":[";
+		auto first = true;
+
+		for (const auto& ring : __rings)
+		{
+			if (!ring->thread_name.empty())
+			{
+				ofs << (first ? "" : ",") << "\n{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":1,\"tid\":" << ring->thread_idx << ",\"args\":{\"name\":";
+				__write_json_string(ofs, ring->thread_name);
+				ofs << "}}";
+				first = false;
+			}
+
+			auto count = ring->write_count.load(memory_order_acquire);
+			auto oldest = count > Ring::capacity ? count - Ring::capacity : 0;
+
+			for (auto event_idx = oldest; event_idx < count; event_idx++)
+			{
+				auto& event = ring->events[event_idx % Ring::capacity];
+
+				ofs << (first ? "" : ",") << "\n{\"name\":";
+				__write_json_string(ofs, event.name);
+				ofs << ",\"ph\":\"X\",\"pid\":1,\"tid\":" << ring->thread_idx
+					<< ",\"ts\":" << event.begin / 1000.0
+					<< ",\"dur\":" << (event.end - event.begin) / 1000.0 << "}";
+				first = false;
+			}
+		}
+
+		ofs << "\n]}\n";
+		return ofs.good();
+	}
+
+	int64_t __now()
+	{
+		return chrono::duration_cast<chrono::nanoseconds>(chrono::steady_clock::now() - __start_time).count();
+	}
+
+	// taken once per thread, a ring of an exited thread first, the only locked step of recording
+	Ring& __thread_ring()
+	{
+		thread_local RingLease lease;
+		if (lease.ring == nullptr)
+		{
+			lock_guard<mutex> lock(__rings_mutex);
+			for (auto& ring : __rings)
+			{
+				if (ring->in_use) continue;
+
+				lease.ring = ring.get();
+				break;
+			}
+
+			if (lease.ring == nullptr)
+			{
+				__rings.push_back(unique_ptr<Ring>(new Ring()));
+				lease.ring = __rings.back().get();
+				lease.ring->thread_idx = (uint32_t)__rings.size() - 1;
+			}
+			lease.ring->in_use = true;
+		}
+		return *lease.ring;
+	}
+
+	RingLease::~RingLease()
+	{
+		if (ring == nullptr) return;
+
+		lock_guard<mutex> lock(__rings_mutex);
+		ring->in_use = false;
+	}
+
+	void __write_json_string(ofstream& ofs, const string& value)
+	{
+		ofs << '"';
+		for (auto c : value)
+		{
+			if (c == '"' || c == '\\') ofs << '\\';
+			ofs << c;
+		}
+		ofs << '"';
+	}
+
+#pragma endregion
+}
+
+#define __RC_TRACE_CONCAT_IMPL(a, b) a##b
+#define __RC_TRACE_CONCAT(a, b) __RC_TRACE_CONCAT_IMPL(a, b)
+#define RC_TRACE_SCOPE(name) trace::Zone __RC_TRACE_CONCAT(__trace_zone_, __LINE__)(name)
+#define RC_TRACE_THREAD_NAME(name) trace::set_thread_name(name)
+#define RC_TRACE_WRITE(path) trace::write_chrome_trace(path)
+
+#else
+
+#define RC_TRACE_SCOPE(name)
+#define RC_TRACE_THREAD_NAME(name)
+#define RC_TRACE_WRITE(path)
+
+#endif // MIXBUILD_TRACE
+
+#endif // !TRACE_H
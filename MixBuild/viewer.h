@@ -4,6 +4,9 @@
 #define VIEWER_H
 
 #include <string>
+#include <cmath>
+#include <algorithm>
+#include <functional>
 
 using namespace std;
 
@@ -53,6 +56,14 @@ namespace viewer
 		int mouse_x, mouse_y;
 		bool left_mouse_is_pressed, right_mouse_is_pressed;
 	};
+
+	// pick the level of detail from the camera distance, every doubling of the distance drops a level
+	inline int select_lod_level(const Frustum& frustum, const WorldTransform& world, const int level_count, const double base_distance = 10)
+	{
+		double distance = max(frustum.eye_z - world.translate_z, base_distance);
+		int level = (int)floor(log2(distance / base_distance));
+		return min(level, level_count - 1);
+	}
 }
 
 #endif // !VIEWER_H